@@ -16,6 +16,8 @@
 #include <linux/kernel.h>         // Contains types, macros, functions for the kernel
 #include <linux/fs.h>             // Header for the Linux file system support
 #include <linux/uaccess.h>          // Required for the copy to user function
+#define  CREATE_TRACE_POINTS
+#include "ebox3char_trace.h"     // The ebox3char:* tracepoints
 #define  DEVICE_NAME "ebox3char"    ///< The device will appear at /dev/ebbchar using this value
 #define  CLASS_NAME  "ebox3"        ///< The device class -- this is a character device driver
 
@@ -106,7 +108,7 @@ static void __exit ebox3char_exit(void){
  */
 static int dev_open(struct inode *inodep, struct file *filep){
    numberOpens++;
-   printk(KERN_INFO "ebox3char: Device has been opened %d time(s)\n", numberOpens);
+   trace_ebox3char_open(numberOpens);
    return 0;
 }
 
@@ -122,13 +124,12 @@ static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *of
    int error_count = 0;
    // copy_to_user has the format ( * to, *from, size) and returns 0 on success
    error_count = copy_to_user(buffer, message, size_of_message);
+   trace_ebox3char_read(size_of_message, error_count);
 
    if (error_count==0){            // if true then have success
-      printk(KERN_INFO "ebox3char: Sent %d characters to the user\n", size_of_message);
       return (size_of_message=0);  // clear the position to the start and return 0
    }
    else {
-      printk(KERN_INFO "ebox3char: Failed to send %d characters to the user\n", error_count);
       return -EFAULT;              // Failed -- return a bad address message (i.e. -14)
    }
 }
@@ -146,7 +147,7 @@ static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, lof
    int error_count = 0;
    error_count = copy_from_user(message, buffer, len);
    size_of_message = strlen(message);                 // store the length of the stored message
-   printk(KERN_INFO "ebox3char: Received %zu characters from the user\n", len);
+   trace_ebox3char_write(len);
    return len;
 }
 
@@ -156,7 +157,7 @@ static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, lof
  *  @param filep A pointer to a file object (defined in linux/fs.h)
  */
 static int dev_release(struct inode *inodep, struct file *filep){
-   printk(KERN_INFO "ebox3char: Device successfully closed\n");
+   trace_ebox3char_release(numberOpens);
    return 0;
 }
 
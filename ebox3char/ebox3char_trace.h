@@ -0,0 +1,76 @@
+/**
+ * The tracepoints of the ebox3char and ebox3charmutex LKMs, they replace the printk calls on
+ * every open, read and write. Both LKMs register /dev/ebox3char and are never loaded together,
+ * so they share the ebox3char trace system. Turn them on with e.g.
+ *   echo 1 > /sys/kernel/debug/tracing/events/ebox3char/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ebox3char
+
+#if !defined(EBOX3CHAR_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define EBOX3CHAR_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** The device was opened, opens is the number of opens so far */
+TRACE_EVENT(ebox3char_open,
+   TP_PROTO(int opens),
+   TP_ARGS(opens),
+   TP_STRUCT__entry(
+      __field(int, opens)
+   ),
+   TP_fast_assign(
+      __entry->opens = opens;
+   ),
+   TP_printk("opens=%d", __entry->opens)
+);
+
+/** A read of the stored message, failed is the number of bytes that could not be copied */
+TRACE_EVENT(ebox3char_read,
+   TP_PROTO(int bytes, int failed),
+   TP_ARGS(bytes, failed),
+   TP_STRUCT__entry(
+      __field(int, bytes)
+      __field(int, failed)
+   ),
+   TP_fast_assign(
+      __entry->bytes  = bytes;
+      __entry->failed = failed;
+   ),
+   TP_printk("bytes=%d failed=%d", __entry->bytes, __entry->failed)
+);
+
+/** A message written by user space */
+TRACE_EVENT(ebox3char_write,
+   TP_PROTO(size_t bytes),
+   TP_ARGS(bytes),
+   TP_STRUCT__entry(
+      __field(size_t, bytes)
+   ),
+   TP_fast_assign(
+      __entry->bytes = bytes;
+   ),
+   TP_printk("bytes=%zu", __entry->bytes)
+);
+
+/** The device was closed */
+TRACE_EVENT(ebox3char_release,
+   TP_PROTO(int opens),
+   TP_ARGS(opens),
+   TP_STRUCT__entry(
+      __field(int, opens)
+   ),
+   TP_fast_assign(
+      __entry->opens = opens;
+   ),
+   TP_printk("opens=%d", __entry->opens)
+);
+
+#endif
+
+// the header is read again by define_trace.h from this directory, the Makefiles add it to the include path
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ebox3char_trace
+#include <trace/define_trace.h>
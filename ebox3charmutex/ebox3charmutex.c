@@ -17,6 +17,8 @@
 #include <linux/fs.h>             // Header for the Linux file system support
 #include <linux/uaccess.h>        // Required for the copy to user function
 #include <linux/mutex.h>          // Required for the mutex functionality
+#define  CREATE_TRACE_POINTS
+#include "../ebox3char/ebox3char_trace.h"  // The ebox3char:* tracepoints, shared with ebox3char
 #define  DEVICE_NAME "ebox3char"  ///< The device will appear at /dev/ebbchar using this value
 #define  CLASS_NAME  "ebox3"      ///< The device class -- this is a character device driver
 
@@ -116,7 +118,7 @@ static int dev_open(struct inode *inodep, struct file *filep){
    }
 
    numberOpens++;
-   printk(KERN_INFO "ebox3char: Device has been opened %d time(s)\n", numberOpens);
+   trace_ebox3char_open(numberOpens);
    return 0;
 }
 
@@ -132,13 +134,12 @@ static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *of
    int error_count = 0;
    // copy_to_user has the format ( * to, *from, size) and returns 0 on success
    error_count = copy_to_user(buffer, message, size_of_message);
+   trace_ebox3char_read(size_of_message, error_count);
 
    if (error_count==0){            // if true then have success
-      printk(KERN_INFO "ebox3char: Sent %d characters to the user\n", size_of_message);
       return (size_of_message=0);  // clear the position to the start and return 0
    }
    else {
-      printk(KERN_INFO "ebox3char: Failed to send %d characters to the user\n", error_count);
       return -EFAULT;              // Failed -- return a bad address message (i.e. -14)
    }
 }
@@ -156,7 +157,7 @@ static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, lof
    int error_count = 0;
    error_count = copy_from_user(message, buffer, len);
    size_of_message = strlen(message);                 // store the length of the stored message
-   printk(KERN_INFO "ebox3char: Received %zu characters from the user\n", len);
+   trace_ebox3char_write(len);
    return len;
 }
 
@@ -167,7 +168,7 @@ static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, lof
  */
 static int dev_release(struct inode *inodep, struct file *filep){
    mutex_unlock(&ebox3char_mutex);                      // release the mutex (i.e., lock goes up)
-   printk(KERN_INFO "ebox3char: Device successfully closed\n");
+   trace_ebox3char_release(numberOpens);
    return 0;
 }
 
@@ -0,0 +1,139 @@
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+
+#define  CTL_DEVICE_NAME "ebox3ctl"         ///< The device will appear at /dev/ebox3ctl
+
+static int    ctlMajor;                     ///< Stores the device number -- determined automatically
+static struct device *ctlDevice = NULL;     ///< The device-driver device struct pointer
+
+/** @brief EBOX3_IOC_RELAYS -- switch a set of relays at once */
+static long ctl_relays(void __user *argp) {
+    struct ebox3_relay_mask req;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if ((req.set | req.clear) & ~RELAYS_ALL || req.reserved)
+        return -EINVAL;
+    req.state = relays_apply(req.set, req.clear);
+    if (copy_to_user(argp, &req, sizeof(req)))
+        return -EFAULT;
+    return 0;
+}
+
+/** @brief EBOX3_IOC_GPIO -- read the levels of all lines at once */
+static long ctl_gpio(void __user *argp) {
+    struct ebox3_gpio_snapshot snap;
+    int result = gpio_bank_snapshot(&snap);
+
+    if (result)
+        return result;
+    if (copy_to_user(argp, &snap, sizeof(snap)))
+        return -EFAULT;
+    return 0;
+}
+
+/** @brief EBOX3_IOC_BATCH -- read meters, switch relays and reset counters in one call
+ *  The counters are read and reset in one step, a pulse is either read or left on the counter.
+ *  struct ebox3_batch is too large for the kernel stack, it is allocated.
+ */
+static long ctl_batch(void __user *argp) {
+    struct ebox3_batch *req;
+    unsigned int i;
+    long result = 0;
+
+    req = kmalloc(sizeof(*req), GFP_KERNEL);
+    if (!req)
+        return -ENOMEM;
+    if (copy_from_user(req, argp, sizeof(*req))) {
+        result = -EFAULT;
+        goto out;
+    }
+    if (req->meters & ~(BIT(METERS_NUM) - 1) || req->reset & ~req->meters ||
+        (req->set | req->clear) & ~RELAYS_ALL || req->reserved) {
+        result = -EINVAL;
+        goto out;
+    }
+
+    req->captureTime = meters_snapshot(req->meter, NULL, NULL, req->reset);
+    req->relays = relays_apply(req->set, req->clear);
+    for (i = 0; i < ARRAY_SIZE(req->meter); i++)
+        if (!(req->meters & BIT(i)))
+            memset(&req->meter[i], 0, sizeof(req->meter[i]));
+    if (copy_to_user(argp, req, sizeof(*req)))
+        result = -EFAULT;
+out:
+    kfree(req);
+    return result;
+}
+
+/** @brief EBOX3_IOC_NOTIFY -- register an eventfd on the pulses of a meter */
+static long ctl_notify(struct file *filep, void __user *argp) {
+    struct ebox3_notify req;
+
+    if (copy_from_user(&req, argp, sizeof(req)))
+        return -EFAULT;
+    if (req.meter < 1 || req.meter > METERS_NUM || req.fd < -1 || req.intervalMs > NOTIFY_INTERVAL_MAX)
+        return -EINVAL;
+    return notify_set(filep, &req);
+}
+
+/** @brief The ioctls of /dev/ebox3ctl, see ebox3uapi.h */
+static long ctl_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    void __user *argp = (void __user *)arg;
+
+    switch (cmd) {
+    case EBOX3_IOC_RELAYS:
+        return ctl_relays(argp);
+    case EBOX3_IOC_GPIO:
+        return ctl_gpio(argp);
+    case EBOX3_IOC_BATCH:
+        return ctl_batch(argp);
+    case EBOX3_IOC_NOTIFY:
+        return ctl_notify(filep, argp);
+    default:
+        return -ENOTTY;
+    }
+}
+
+/** @brief The eventfds a file registered go away with it */
+static int ctl_release(struct inode *inodep, struct file *filep) {
+    notify_release(filep);
+    return 0;
+}
+
+static const struct file_operations ctl_fops = {
+    .owner          = THIS_MODULE,
+    .open           = nonseekable_open,
+    .release        = ctl_release,
+    .unlocked_ioctl = ctl_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .llseek         = no_llseek,
+};
+
+/** @brief Register /dev/ebox3ctl
+ *  @param cls the ebox3 device class
+ *  @return returns 0 if successful
+ */
+static int ctl_init(struct class *cls) {
+    ctlMajor = register_chrdev(0, CTL_DEVICE_NAME, &ctl_fops);
+    if (ctlMajor < 0) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to register a major number for %s\n", CTL_DEVICE_NAME);
+        return ctlMajor;
+    }
+
+    ctlDevice = device_create(cls, NULL, MKDEV(ctlMajor, 0), NULL, CTL_DEVICE_NAME);
+    if (IS_ERR(ctlDevice)) {
+        unregister_chrdev(ctlMajor, CTL_DEVICE_NAME);
+        printk(KERN_ALERT "Ebox3 Driver: failed to create the %s device\n", CTL_DEVICE_NAME);
+        return PTR_ERR(ctlDevice);
+    }
+    return 0;
+}
+
+static void ctl_exit(struct class *cls) {
+    device_destroy(cls, MKDEV(ctlMajor, 0));
+    unregister_chrdev(ctlMajor, CTL_DEVICE_NAME);
+}
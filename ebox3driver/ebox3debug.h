@@ -0,0 +1,108 @@
+#include <linux/kernel.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+/**
+ * The debugfs entries appear at /sys/kernel/debug/ebox3 if debugfs is mounted. They are for
+ * looking into the driver only, nothing in here is a stable interface.
+ */
+static struct dentry *debugDir = NULL;
+
+/** @brief Displays the interval statistics of a meter, times in nanoseconds
+ *  The count, min, max and mean first and then a "from to count" line per non-empty bucket.
+ */
+static int intervals_show(struct seq_file *s, void *unused) {
+    struct ebox3_meter *meter = s->private;
+    struct meter_intervals iv;
+    unsigned int b;
+
+    meter_read_intervals(meter, &iv);
+    seq_printf(s, "count %llu\nmin %llu\nmax %llu\nmean %llu\n", iv.count, iv.min, iv.max,
+               iv.count ? div64_u64(iv.sum, iv.count) : 0);
+    for (b = 0; b < INTERVAL_BUCKETS; b++) {
+        if (!iv.bucket[b])
+            continue;
+        seq_printf(s, "%llu %llu %u\n", b ? 1024ULL << (b - 1) : 0ULL,
+                   b < INTERVAL_BUCKETS - 1 ? (1024ULL << b) - 1 : U64_MAX, iv.bucket[b]);
+    }
+    return 0;
+}
+
+static int intervals_open(struct inode *inode, struct file *filep) {
+    return single_open(filep, intervals_show, inode->i_private);
+}
+
+/** @brief Any write clears the interval statistics of the meter */
+static ssize_t intervals_write(struct file *filep, const char __user *buffer, size_t len, loff_t *offset) {
+    struct ebox3_meter *meter = ((struct seq_file *)filep->private_data)->private;
+
+    meter_reset_intervals(meter);
+    return len;
+}
+
+static const struct file_operations intervals_fops = {
+    .owner   = THIS_MODULE,
+    .open    = intervals_open,
+    .read    = seq_read,
+    .write   = intervals_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/** @brief Displays the IRQ histograms of a meter, times in nanoseconds
+ *  hardirq is the time spent in the hard IRQ handler, wakeup the time from the hard IRQ of an
+ *  edge until the IRQ thread runs and thread the time spent in the IRQ thread. The GPIO
+ *  controller does not timestamp the edges, the time an edge waits for the hard IRQ handler
+ *  can not be measured.
+ */
+static int irq_show(struct seq_file *s, void *unused) {
+    struct ebox3_meter *meter = s->private;
+
+    irq_hist_show(s, "hardirq", &meter->irqStats.hardCost);
+    irq_hist_show(s, "wakeup", &meter->irqStats.wakeup);
+    irq_hist_show(s, "thread", &meter->irqStats.threadCost);
+    return 0;
+}
+
+static int irq_open(struct inode *inode, struct file *filep) {
+    return single_open(filep, irq_show, inode->i_private);
+}
+
+/** @brief Any write clears the IRQ histograms of the meter */
+static ssize_t irq_write(struct file *filep, const char __user *buffer, size_t len, loff_t *offset) {
+    struct ebox3_meter *meter = ((struct seq_file *)filep->private_data)->private;
+
+    irq_stats_reset(&meter->irqStats);
+    return len;
+}
+
+static const struct file_operations irq_fops = {
+    .owner   = THIS_MODULE,
+    .open    = irq_open,
+    .read    = seq_read,
+    .write   = irq_write,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/** @brief Create /sys/kernel/debug/ebox3, a failure is not an error for the driver */
+static void debug_init(void) {
+    struct dentry *dir;
+    char name[8];
+    unsigned int i;
+
+    debugDir = debugfs_create_dir("ebox3", NULL);
+    debugfs_create_file("irqstats", 0644, debugDir, NULL, &irqstats_fops);
+    for (i = 0; i < METERS_NUM; i++) {
+        snprintf(name, sizeof(name), "m%u", meters[i].id);
+        dir = debugfs_create_dir(name, debugDir);
+        debugfs_create_file("intervals", 0644, dir, &meters[i], &intervals_fops);
+        debugfs_create_file("irq", 0644, dir, &meters[i], &irq_fops);
+    }
+}
+
+static void debug_exit(void) {
+    debugfs_remove_recursive(debugDir);
+    debugDir = NULL;
+}
@@ -6,6 +6,13 @@
  * The sysfs entry appears at
  * /sys/ebox3/relays/r1..4
  * /sys/ebox3/meters/m1..6/...
+ * /sys/ebox3/shed/rules
+ * /sys/ebox3/gpio/snapshot
+ * The pulse timestamps of all meters can be read in binary from /dev/ebox3pulses
+ * and the counters and relay states can be mapped read-only from /dev/ebox3shared.
+ * /dev/ebox3ctl takes the ioctls of ebox3uapi.h, also the eventfds signalled on meter pulses.
+ * Meter pulses, input edges and relay switches can be read in binary from /dev/ebox3events.
+ * Statistics for debugging are in /sys/kernel/debug/ebox3
 */
 
 #include <linux/init.h>
@@ -13,24 +20,34 @@
 #include <linux/kernel.h>
 #include <linux/interrupt.h>
 #include <linux/kobject.h>
+#include <linux/device.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Yuriy Kozhynov <ykozhynov@ipkeys.com>");
 MODULE_DESCRIPTION("Driver for EISSbox3");
 MODULE_VERSION("0.1");
 
-#define  DEBOUNCE_TIME 80     // The default bounce time - 80ms
+#define  DEBOUNCE_TIME 80     // The default bounce time - 80us, gpio_set_debounce() takes microseconds
+#define  DEBOUNCE_MAX  1000000 // The longest bounce time that can be set from sysfs - 1s
+#define  CLASS_NAME  "ebox3"  // The device class of the /dev/ebox3* character devices
 
+#define  CREATE_TRACE_POINTS   // the tracepoints are defined here, the headers below only use them
+#include "ebox3trace.h"
+
+#include "ebox3shared.h"
+#include "ebox3events.h"
 #include "ebox3relays.h"
-#include "ebox3meter1.h"
-#include "ebox3meter2.h"
-#include "ebox3meter3.h"
-#include "ebox3meter4.h"
-#include "ebox3meter5.h"
-#include "ebox3meter6.h"
+#include "ebox3meters.h"
+#include "ebox3shed.h"
+#include "ebox3notify.h"
+#include "ebox3gpio.h"
+#include "ebox3pulses.h"
+#include "ebox3ctl.h"
+#include "ebox3debug.h"
 
 static struct kobject *ebox3_kobj;
 static struct kobject *meters_kobj;
+static struct class *ebox3Class = NULL;
 
 /** @brief The LKM initialization function
  *  The static keyword restricts the visibility of the function to within this C file. The __init
@@ -45,111 +62,94 @@ static int __init ebox3driver_init(void) {
 
     printk(KERN_INFO "Ebox3 Driver: Init\n");
 
+    // the page shared with user space is updated by the relays and meters from the start
+    result = shared_alloc(METERS_NUM, RELAYS_NUM);
+    if (result) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to allocate the shared page\n");
+        return result;
+    }
+
     // create the kobject sysfs entry at /sys/ebox3
     ebox3_kobj = kobject_create_and_add("ebox3", kernel_kobj->parent); // kernel_kobj points to /sys/kernel
     if (!ebox3_kobj){
         printk(KERN_ALERT "Ebox3 Driver: failed to create ebox3 kobject mapping\n");
-        return -ENOMEM;
+        result = -ENOMEM;
+        goto err_shared;
     }
     // add the attributes to /sys/ebox3/relays/r1..4
     result = sysfs_create_group(ebox3_kobj, &relays_group);
     if (result) {
         printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for relays\n");
-        kobject_put(ebox3_kobj);
-        return result;
+        goto err_ebox3_kobj;
     }
 
     meters_kobj = kobject_create_and_add("meters", ebox3_kobj);
-   
-    // add the attributes to /sys/ebox3/meters/m1..6/...
-    result = sysfs_create_group(meters_kobj, &meter_group_1);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter1\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = sysfs_create_group(meters_kobj, &meter_group_2);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter2\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = sysfs_create_group(meters_kobj, &meter_group_3);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter3\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = sysfs_create_group(meters_kobj, &meter_group_4);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter4\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = sysfs_create_group(meters_kobj, &meter_group_5);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter5\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = sysfs_create_group(meters_kobj, &meter_group_6);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter6\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
+    if (!meters_kobj) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to create meters kobject mapping\n");
+        result = -ENOMEM;
+        goto err_ebox3_kobj;
     }
 
     relays_init();
 
-    result = meter_init_1(IRQflags);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to init meter1\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = meter_init_2(IRQflags);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to init meter2\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = meter_init_3(IRQflags);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to init meter3\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = meter_init_4(IRQflags);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to init meter4\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-    result = meter_init_5(IRQflags);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to init meter5\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
+    // add the meters and their attributes to /sys/ebox3/meters/m1..6/...
+    result = meters_init(meters_kobj, IRQflags);
+    if (result)
+        goto err_relays;
+
+    // the load shedding rules at /sys/ebox3/shed
+    result = shed_init(ebox3_kobj);
+    if (result)
+        goto err_meters;
+    result = gpio_bank_init(ebox3_kobj);
+    if (result)
+        goto err_shed;
+
+    // Register the device class and the character devices
+    ebox3Class = class_create(THIS_MODULE, CLASS_NAME);
+    if (IS_ERR(ebox3Class)) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to register device class\n");
+        result = PTR_ERR(ebox3Class);
+        goto err_gpio;
     }
-    result = meter_init_6(IRQflags);
-    if (result) {
-        printk(KERN_ALERT "Ebox3 Driver: failed to init meter6\n");
-        kobject_put(meters_kobj);
-        kobject_put(ebox3_kobj);
-        return result;
-    }
-
+    result = pulses_init(ebox3Class);
+    if (result)
+        goto err_class;
+    result = shared_init(ebox3Class);
+    if (result)
+        goto err_pulses;
+    result = ctl_init(ebox3Class);
+    if (result)
+        goto err_shared_dev;
+    result = events_init(ebox3Class);
+    if (result)
+        goto err_ctl;
+
+    debug_init();
+    return 0;
+
+    // undo the steps above in reverse order
+err_ctl:
+    ctl_exit(ebox3Class);
+err_shared_dev:
+    shared_exit(ebox3Class);
+err_pulses:
+    pulses_exit(ebox3Class);
+err_class:
+    class_destroy(ebox3Class);
+err_gpio:
+    gpio_bank_exit(ebox3_kobj);
+err_shed:
+    shed_exit(ebox3_kobj);
+err_meters:
+    meters_exit();
+err_relays:
+    relays_exit(ebox3_kobj);
+    kobject_put(meters_kobj);
+err_ebox3_kobj:
+    kobject_put(ebox3_kobj);
+err_shared:
+    shared_free();
     return result;
 }
 
@@ -158,17 +158,23 @@ static int __init ebox3driver_init(void) {
  *  code is used for a built-in driver (not a LKM) that this function is not required.
  */
 static void __exit ebox3driver_exit(void) {
+    debug_exit();
+    events_exit(ebox3Class);
+    ctl_exit(ebox3Class);
+    shared_exit(ebox3Class);
+    pulses_exit(ebox3Class);
+    class_destroy(ebox3Class);
+
+    gpio_bank_exit(ebox3_kobj);
+    shed_exit(ebox3_kobj);
+    meters_exit();
+    relays_exit(ebox3_kobj);
+
     // clean up -- remove the kobject sysfs entry
     kobject_put(meters_kobj);
     kobject_put(ebox3_kobj);
 
-    relays_exit();
-    meter_exit_1();
-    meter_exit_2();
-    meter_exit_3();
-    meter_exit_4();
-    meter_exit_5();
-    meter_exit_6();
+    shared_free();
 
     printk(KERN_INFO "Ebox3 Driver: Exit\n");
 }
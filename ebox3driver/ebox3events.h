@@ -0,0 +1,248 @@
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include "ebox3uapi.h"
+
+#define  EVENTS_DEVICE_NAME "ebox3events"   ///< The device will appear at /dev/ebox3events
+#define  EVENTS_RING_SIZE   4096            ///< Events kept for the readers, must be a power of 2
+#define  EVENTS_CHUNK       (PAGE_SIZE / sizeof(struct ebox3_event))   ///< Events moved per copy_to_user()
+
+static int    eventsMajor;                  ///< Stores the device number -- determined automatically
+static struct device *eventsDevice = NULL;  ///< The device-driver device struct pointer
+
+/**
+ * All events go to one ring that every open file reads with a cursor of its own, so the readers
+ * never wait for each other. eventsHead counts the events ever pushed and wraps like the
+ * cursors do. A reader that falls more than the ring size behind loses its oldest events and
+ * counts them as overruns. The writers run in any context and serialize on events_lock.
+ */
+static struct ebox3_event eventsRing[EVENTS_RING_SIZE];
+static unsigned long eventsHead = 0;
+static atomic_t eventsReaders = ATOMIC_INIT(0);     ///< Open files, no event is kept without one
+static DEFINE_SPINLOCK(events_lock);
+static DECLARE_WAIT_QUEUE_HEAD(events_wq);
+
+/** The state of one open file of /dev/ebox3events */
+struct events_reader {
+    struct mutex lock;              // serializes the reads through this file
+    unsigned long cursor;           // the next event this file reads
+    u32 mask;                       // BIT(type) of the events this file reads
+    u64 overruns;                   // events lost because this file fell behind
+    struct ebox3_event *chunk;      // bounce buffer of EVENTS_CHUNK events
+};
+
+/** @brief Publish an event, any context, the readers are woken up by events_wake()
+ *  @param type      the EBOX3_EVENT_* type
+ *  @param source    the meter or relay number, 1 for m1 or r1
+ *  @param timestamp the CLOCK_MONOTONIC time of the event in ns
+ */
+static void events_push(u16 type, u16 source, u32 value, u64 timestamp) {
+    struct ebox3_event *event;
+    unsigned long flags;
+
+    if (!atomic_read(&eventsReaders))
+        return;
+
+    spin_lock_irqsave(&events_lock, flags);
+    event = &eventsRing[eventsHead & (EVENTS_RING_SIZE - 1)];
+    event->timestamp = timestamp;
+    event->type      = type;
+    event->source    = source;
+    event->value     = value;
+    WRITE_ONCE(eventsHead, eventsHead + 1);
+    spin_unlock_irqrestore(&events_lock, flags);
+}
+
+/** @brief Wake up the readers once for the events pushed so far */
+static void events_wake(void) {
+    if (wq_has_sleeper(&events_wq))
+        wake_up_interruptible(&events_wq);
+}
+
+static bool events_pending(struct events_reader *reader) {
+    return READ_ONCE(eventsHead) != READ_ONCE(reader->cursor);
+}
+
+/** @brief Copy the next subscribed events of a reader into its bounce buffer
+ *  @param max the most events to copy, up to EVENTS_CHUNK
+ *  @return returns the number of events copied, 0 once the reader has caught up
+ */
+static unsigned int events_fetch(struct events_reader *reader, unsigned int max) {
+    struct ebox3_event *event;
+    unsigned long flags, head;
+    unsigned int n = 0;
+
+    spin_lock_irqsave(&events_lock, flags);
+    head = eventsHead;
+    if (head - reader->cursor > EVENTS_RING_SIZE) {
+        reader->overruns += head - reader->cursor - EVENTS_RING_SIZE;
+        reader->cursor = head - EVENTS_RING_SIZE;
+    }
+    while (reader->cursor != head && n < max) {
+        event = &eventsRing[reader->cursor & (EVENTS_RING_SIZE - 1)];
+        reader->cursor++;
+        if (reader->mask & BIT(event->type))
+            reader->chunk[n++] = *event;
+    }
+    spin_unlock_irqrestore(&events_lock, flags);
+    return n;
+}
+
+/** @brief Read the events the file subscribed to
+ *  The read blocks until at least one event is available unless O_NONBLOCK is set and then
+ *  returns as many whole struct ebox3_event as fit in the buffer.
+ *  @param filep A pointer to a file object
+ *  @param buffer The user buffer, its length should be a multiple of the record size
+ *  @param len The length of the buffer
+ *  @param offset Not used, the device is a stream
+ */
+static ssize_t events_read(struct file *filep, char __user *buffer, size_t len, loff_t *offset) {
+    struct events_reader *reader = filep->private_data;
+    size_t max = len / sizeof(struct ebox3_event);
+    size_t done = 0;
+    unsigned int n;
+    int result;
+
+    if (max == 0)
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&reader->lock))
+        return -ERESTARTSYS;
+
+    for (;;) {
+        while (done < max) {
+            n = events_fetch(reader, min_t(size_t, max - done, EVENTS_CHUNK));
+            if (n == 0)
+                break;
+            if (copy_to_user(buffer + done * sizeof(reader->chunk[0]), reader->chunk, n * sizeof(reader->chunk[0]))) {
+                mutex_unlock(&reader->lock);
+                return -EFAULT;
+            }
+            done += n;
+        }
+        if (done || (filep->f_flags & O_NONBLOCK))
+            break;
+
+        // nothing new yet -- sleep until an event is pushed
+        mutex_unlock(&reader->lock);
+        result = wait_event_interruptible(events_wq, events_pending(reader));
+        if (result)
+            return result;
+        if (mutex_lock_interruptible(&reader->lock))
+            return -ERESTARTSYS;
+    }
+    mutex_unlock(&reader->lock);
+
+    if (done == 0)
+        return -EAGAIN;
+    return done * sizeof(struct ebox3_event);
+}
+
+/** @brief Readable while events are pending, also those of types the file did not subscribe to */
+static __poll_t events_poll(struct file *filep, poll_table *wait) {
+    struct events_reader *reader = filep->private_data;
+
+    poll_wait(filep, &events_wq, wait);
+    return events_pending(reader) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+/** @brief The ioctls of /dev/ebox3events, see ebox3uapi.h */
+static long events_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    struct events_reader *reader = filep->private_data;
+    u64 overruns;
+    u32 mask;
+
+    switch (cmd) {
+    case EBOX3_IOC_EVENTS_MASK:
+        if (get_user(mask, (__u32 __user *)arg))
+            return -EFAULT;
+        if (mask & ~EBOX3_EVENTS_ALL)
+            return -EINVAL;
+        mutex_lock(&reader->lock);
+        reader->mask = mask;
+        mutex_unlock(&reader->lock);
+        return 0;
+    case EBOX3_IOC_EVENTS_OVERRUNS:
+        mutex_lock(&reader->lock);
+        overruns = reader->overruns;
+        mutex_unlock(&reader->lock);
+        return copy_to_user((void __user *)arg, &overruns, sizeof(overruns)) ? -EFAULT : 0;
+    default:
+        return -ENOTTY;
+    }
+}
+
+/** @brief A new reader starts with the next event and subscribes to all types */
+static int events_open(struct inode *inodep, struct file *filep) {
+    struct events_reader *reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+    unsigned long flags;
+
+    if (!reader)
+        return -ENOMEM;
+    reader->chunk = kmalloc_array(EVENTS_CHUNK, sizeof(reader->chunk[0]), GFP_KERNEL);
+    if (!reader->chunk) {
+        kfree(reader);
+        return -ENOMEM;
+    }
+    mutex_init(&reader->lock);
+    reader->mask = EBOX3_EVENTS_ALL;
+
+    spin_lock_irqsave(&events_lock, flags);
+    reader->cursor = eventsHead;
+    atomic_inc(&eventsReaders);
+    spin_unlock_irqrestore(&events_lock, flags);
+
+    filep->private_data = reader;
+    return nonseekable_open(inodep, filep);
+}
+
+static int events_release(struct inode *inodep, struct file *filep) {
+    struct events_reader *reader = filep->private_data;
+
+    atomic_dec(&eventsReaders);
+    kfree(reader->chunk);
+    kfree(reader);
+    return 0;
+}
+
+static const struct file_operations events_fops = {
+    .owner          = THIS_MODULE,
+    .open           = events_open,
+    .release        = events_release,
+    .read           = events_read,
+    .poll           = events_poll,
+    .unlocked_ioctl = events_ioctl,
+    .compat_ioctl   = compat_ptr_ioctl,
+    .llseek         = no_llseek,
+};
+
+/** @brief Register /dev/ebox3events
+ *  @param cls the ebox3 device class
+ *  @return returns 0 if successful
+ */
+static int events_init(struct class *cls) {
+    eventsMajor = register_chrdev(0, EVENTS_DEVICE_NAME, &events_fops);
+    if (eventsMajor < 0) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to register a major number for %s\n", EVENTS_DEVICE_NAME);
+        return eventsMajor;
+    }
+
+    eventsDevice = device_create(cls, NULL, MKDEV(eventsMajor, 0), NULL, EVENTS_DEVICE_NAME);
+    if (IS_ERR(eventsDevice)) {
+        unregister_chrdev(eventsMajor, EVENTS_DEVICE_NAME);
+        printk(KERN_ALERT "Ebox3 Driver: failed to create the %s device\n", EVENTS_DEVICE_NAME);
+        return PTR_ERR(eventsDevice);
+    }
+    return 0;
+}
+
+static void events_exit(struct class *cls) {
+    device_destroy(cls, MKDEV(eventsMajor, 0));
+    unregister_chrdev(eventsMajor, EVENTS_DEVICE_NAME);
+}
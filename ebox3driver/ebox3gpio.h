@@ -0,0 +1,85 @@
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
+
+/**
+ * All lines of the driver in one array, the meter inputs first, then the meter outputs and
+ * the relays. gpiolib reads the lines of one chip with a single get_multiple call, so a
+ * snapshot of all of them costs one register read per GPIO bank.
+ */
+#define GPIO_BANK_LINES (2 * METERS_NUM + RELAYS_NUM)
+
+static struct gpio_desc *gpioBankDescs[GPIO_BANK_LINES];
+
+/** @brief Read the level of every line of the driver at once, process context only
+ *  @param snap receives the levels as bitmaps and the CLOCK_MONOTONIC time of the read
+ *  @return returns 0 if successful
+ */
+static int gpio_bank_snapshot(struct ebox3_gpio_snapshot *snap) {
+    DECLARE_BITMAP(levels, GPIO_BANK_LINES);
+    int result;
+
+    BUILD_BUG_ON(GPIO_BANK_LINES > BITS_PER_LONG);
+    bitmap_zero(levels, GPIO_BANK_LINES);
+    result = gpiod_get_raw_array_value(GPIO_BANK_LINES, gpioBankDescs, NULL, levels);
+    snap->timestamp = ktime_get_ns();
+    if (result)
+        return result;
+
+    snap->inputs   = levels[0] & (BIT(METERS_NUM) - 1);
+    snap->outputs  = (levels[0] >> METERS_NUM) & (BIT(METERS_NUM) - 1);
+    snap->relays   = (levels[0] >> (2 * METERS_NUM)) & RELAYS_ALL;
+    snap->reserved = 0;
+    return 0;
+}
+
+/** @brief Displays the levels of all lines, "time <ns>" and the inputs, outputs and relays as bitmasks
+ *  Bit 0 is m1 or r1, the time is CLOCK_MONOTONIC.
+ */
+static ssize_t snapshot_levels_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_gpio_snapshot snap;
+    int result = gpio_bank_snapshot(&snap);
+
+    if (result)
+        return result;
+    return sprintf(buf, "time %llu\ninputs 0x%x\noutputs 0x%x\nrelays 0x%x\n", snap.timestamp,
+                   snap.inputs, snap.outputs, snap.relays);
+}
+
+static struct kobj_attribute gpio_snapshot_attr = __ATTR(snapshot, 0444, snapshot_levels_show, NULL);
+
+static struct attribute *gpio_attrs[] = {
+    &gpio_snapshot_attr.attr,
+    NULL,
+};
+
+static struct attribute_group gpio_group = {
+    .name  = "gpio",
+    .attrs = gpio_attrs,
+};
+
+/** @brief Add /sys/ebox3/gpio, must be called once the relays and meters are set up
+ *  @param parent the /sys/ebox3 kobject
+ *  @return returns 0 if successful
+ */
+static int gpio_bank_init(struct kobject *parent) {
+    unsigned int i;
+    int result;
+
+    for (i = 0; i < METERS_NUM; i++) {
+        gpioBankDescs[i]              = gpio_to_desc(meters[i].gpioIn);
+        gpioBankDescs[METERS_NUM + i] = gpio_to_desc(meters[i].gpioOut);
+    }
+    for (i = 0; i < RELAYS_NUM; i++)
+        gpioBankDescs[2 * METERS_NUM + i] = relayDescs[i];
+
+    result = sysfs_create_group(parent, &gpio_group);
+    if (result)
+        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for gpio\n");
+    return result;
+}
+
+static void gpio_bank_exit(struct kobject *parent) {
+    sysfs_remove_group(parent, &gpio_group);
+}
@@ -0,0 +1,104 @@
+/**
+ * The IRQ timing histograms, shared by ebox3driver, ebox3inputs and gpio_test. Every module
+ * that includes this gets its own static key and its own <debugfs>/<module>/irqstats switch.
+ */
+#include <linux/kernel.h>
+#include <linux/jump_label.h>
+#include <linux/seq_file.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+
+#define IRQ_HIST_BUCKETS 32     // log2 buckets of ns, bucket n counts 2^(n-1) to 2^n - 1 ns
+
+/**
+ * The IRQ instrumentation is off by default, the static key patches the timing code out of the
+ * handlers until it is switched on through irqstats_fops.
+ */
+static DEFINE_STATIC_KEY_FALSE(irqStatsKey);
+
+/**
+ * A histogram of durations, written by one handler of one IRQ only. Readers copy it and the
+ * debugfs reset clears it without a lock, the counts may be one off against each other.
+ */
+struct irq_hist {
+    u32 count;
+    u32 max;            // ns, saturates at 4.29 s
+    u32 bucket[IRQ_HIST_BUCKETS];
+};
+
+/** The histograms of one threaded IRQ */
+struct irq_stats {
+    struct irq_hist hardCost;   // time spent in the hard IRQ handler
+    struct irq_hist wakeup;     // from the hard IRQ of the oldest queued edge to the IRQ thread
+    struct irq_hist threadCost; // time spent in the IRQ thread
+};
+
+/** @brief Account a duration in nanoseconds */
+static inline void irq_hist_add(struct irq_hist *hist, u64 ns) {
+    u32 value = min_t(u64, ns, U32_MAX);
+
+    hist->bucket[min_t(unsigned int, fls(value), IRQ_HIST_BUCKETS - 1)]++;
+    hist->count++;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+/** @brief Clear a histogram while its handler may be running
+ *  Nothing is held off, an update that races with the reset may leave a single count behind.
+ */
+static void irq_hist_reset(struct irq_hist *hist) {
+    unsigned int b;
+
+    WRITE_ONCE(hist->count, 0);
+    WRITE_ONCE(hist->max, 0);
+    for (b = 0; b < IRQ_HIST_BUCKETS; b++)
+        WRITE_ONCE(hist->bucket[b], 0);
+}
+
+static inline void irq_stats_reset(struct irq_stats *stats) {
+    irq_hist_reset(&stats->hardCost);
+    irq_hist_reset(&stats->wakeup);
+    irq_hist_reset(&stats->threadCost);
+}
+
+/** @brief Print one histogram as a "name count max" line and a "from to count" line per non-empty bucket */
+static void irq_hist_show(struct seq_file *s, const char *name, const struct irq_hist *hist) {
+    unsigned int b;
+
+    seq_printf(s, "%s %u %u\n", name, hist->count, hist->max);
+    for (b = 0; b < IRQ_HIST_BUCKETS; b++) {
+        if (!hist->bucket[b])
+            continue;
+        seq_printf(s, "%u %u %u\n", b ? 1U << (b - 1) : 0U,
+                   b < IRQ_HIST_BUCKETS - 1 ? (1U << b) - 1 : U32_MAX, hist->bucket[b]);
+    }
+}
+
+/** @brief Displays 1 if the IRQ histograms are being filled in */
+static ssize_t irqstats_read(struct file *filep, char __user *buffer, size_t len, loff_t *offset) {
+    char state[2] = { static_key_enabled(&irqStatsKey) ? '1' : '0', '\n' };
+
+    return simple_read_from_buffer(buffer, len, offset, state, sizeof(state));
+}
+
+/** @brief Switches the IRQ instrumentation on or off, takes 0/1, y/n or on/off */
+static ssize_t irqstats_write(struct file *filep, const char __user *buffer, size_t len, loff_t *offset) {
+    bool enable;
+    int result;
+
+    result = kstrtobool_from_user(buffer, len, &enable);
+    if (result)
+        return result;
+    if (enable)
+        static_branch_enable(&irqStatsKey);
+    else
+        static_branch_disable(&irqStatsKey);
+    return len;
+}
+
+static const struct file_operations irqstats_fops = {
+    .owner  = THIS_MODULE,
+    .read   = irqstats_read,
+    .write  = irqstats_write,
+    .llseek = default_llseek,
+};
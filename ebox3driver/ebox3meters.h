@@ -0,0 +1,1551 @@
+#include <linux/kernel.h>
+#include <linux/cache.h>
+#include <linux/time.h>
+#include <linux/math64.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/interrupt.h>
+#include <linux/gpio.h>
+#include <linux/kobject.h>
+#include <linux/wait.h>
+#include <linux/irq_work.h>
+#include <linux/hrtimer.h>
+#include <linux/delay.h>
+#include <linux/workqueue.h>
+#include <linux/sched.h>
+#include <linux/sched/types.h>
+#include <linux/sysfs.h>
+#include "ebox3uapi.h"
+#include "ebox3rate.h"
+#include "ebox3irqstats.h"
+#include "ebox3repeat.h"
+
+/**
+ * The meter pin table -- one row per meter, m1 is the first row.
+ * Adding a meter is a matter of adding a row here.
+ */
+static const struct meter_pins {
+    unsigned int gpioIn;
+    unsigned int gpioOut;
+} meter_pins[] = {
+    { 112, 113 },   // m1
+    { 110, 111 },   // m2
+    {  44,  45 },   // m3
+    {  46,  47 },   // m4
+    {  78,  79 },   // m5
+    {  80,  81 },   // m6
+};
+
+#define METERS_NUM ARRAY_SIZE(meter_pins)
+
+#define PULSE_RING_SIZE 1024    // Pulse timestamps buffered per meter, must be a power of 2
+
+/**
+ * Every meter keeps a single-producer/single-consumer ring of pulse timestamps. meter_count()
+ * is the only writer of ringHead/ringDropped and the /dev/ebox3pulses reader is the only
+ * writer of ringTail/ringDroppedSeen, so no lock is needed on either side.
+ */
+static u64 meter_ring[METERS_NUM][PULSE_RING_SIZE];
+
+static DECLARE_WAIT_QUEUE_HEAD(pulses_wq);     ///< /dev/ebox3pulses readers waiting for a pulse
+
+#define STORM_WINDOW_NS   (100 * NSEC_PER_MSEC) // The storm guard measures the edge rate over 100ms
+#define STORM_LIMIT       5000                  // The default edge rate that trips the storm guard - 5kHz
+#define STORM_HOLD_MIN_NS (1 * NSEC_PER_SEC)    // A tripped meter samples at least 1s, doubled on every
+#define STORM_HOLD_MAX_NS (64 * NSEC_PER_SEC)   // trip that follows shortly after a re-arm, up to 64s
+#define SAMPLE_RATE_MAX   10000                 // The pulse rate the bank sampler counts exactly up to by default - 10kHz
+#define SAMPLE_PERIOD     (USEC_PER_SEC / (2 * SAMPLE_RATE_MAX)) // The default level sampling period - 50us, two per pulse at SAMPLE_RATE_MAX
+#define SAMPLE_PERIOD_MIN 50                    // The shortest level sampling period - 50us
+#define REPLAY_WINDOW_NS  (20 * NSEC_PER_USEC)  // An IRQ this close to the re-arm is the replay of an old edge
+
+#define CAPTURE_SIZE      256                   // Edges queued from the hard IRQ for the thread, a power of 2
+#define THREAD_PRIORITY   50                    // The default SCHED_FIFO priority of the meter IRQ threads
+
+/**
+ * The hard IRQ handler only takes the time of an edge and queues it for the IRQ thread,
+ * a single-producer/single-consumer ring per meter as well.
+ */
+static u64 meter_capture[METERS_NUM][CAPTURE_SIZE];
+
+static int threadPriority = THREAD_PRIORITY;
+module_param(threadPriority, int, 0444);
+MODULE_PARM_DESC(threadPriority, " SCHED_FIFO priority of the meter IRQ threads (default=50)");
+static atomic_t threadPriorityGen = ATOMIC_INIT(1);    ///< Bumped on a change of threadPriority
+
+/** How a meter input is counted */
+enum meter_mode {
+    METER_IRQ,          // every edge raises an IRQ
+    METER_SAMPLING,     // the IRQ is disabled, the bank sampler polls the input level
+};
+
+/**
+ * The per-meter state. The fields touched by the IRQ handler on every pulse come first
+ * and every meter starts on its own cache line, so meters never share a line.
+ */
+struct ebox3_meter {
+    // hot -- hard IRQ, edge times queued for the IRQ thread
+    u64 *capture;
+    unsigned int captureHead;
+    unsigned int captureTail;   // written by the IRQ thread
+    unsigned int captureOverruns;
+
+    // hot -- storm guard, counts every IRQ of the meter
+    u64 stormStart;             // CLOCK_MONOTONIC ns the current rate window started
+    u32 stormEdges;             // edges seen in the current rate window
+    u32 stormWindowEdges;       // edges per window that trip the guard, 0 turns it off
+    bool stormTripped;          // the IRQ was disabled, the IRQ thread starts the sampling
+    bool replayGuard;           // the next edge may be the replay of an edge seen while sampling
+
+    // hot -- software debounce, checked first by the IRQ thread
+    u64 lastEdge;               // CLOCK_MONOTONIC ns of the last accepted edge
+    u32 debounceNs;             // edges closer than this to lastEdge are bounces
+    bool swDebounce;            // the GPIO controller has no debounce, filter edges here
+    bool confirm;               // count an edge only if the level still holds after debounceNs
+    bool confirmPending;        // confirmTimer owns the meter until it has checked the level
+    unsigned int bounces;       // edges rejected by the IRQ handler
+    unsigned int glitches;      // edges rejected by confirmTimer
+
+    // hot -- written by meter_count(), pulses and lastTime are published together under seq
+    spinlock_t lock;            // serializes the writers of seq, the counting paths and the resets
+    seqcount_t seq;
+    u64 pulses;
+    u64 lastTime;               // CLOCK_REALTIME ns of the last pulse
+    struct meter_rate rate;
+    struct meter_intervals intervals;
+    u64 gated[RELAYS_NUM];      // pulses counted while the relay was on since the counter was written, index 0 is r1
+    u32 notifyPulses;           // pulses ever counted, wraps, read by the eventfds without seq
+    u64 *ring;
+    unsigned int ringHead;
+    unsigned int ringDropped;
+    struct irq_work notifyWork; // wakes up the pollers once the hard IRQ is over
+
+    // written by the ring reader only, kept off the line of the IRQ handler
+    unsigned int ringTail ____cacheline_aligned;
+    unsigned int ringDroppedSeen;
+
+    // cold -- set up once by meter_init()
+    unsigned int id;
+    unsigned int gpioIn;
+    unsigned int gpioOut;
+    int irq;
+    int activeLevel;            // the input level after a counted edge
+    u64 confirmEdge;            // the edge confirmTimer is checking
+    struct hrtimer confirmTimer;
+
+    // storm guard -- the meter is sampled by the bank sampler while its IRQ is disabled
+    enum meter_mode mode;
+    int sampleLevel;            // the input level at the last sample
+    u32 samplePeriodNs;
+    u64 sampleUntil;            // CLOCK_MONOTONIC ns before which the meter stays sampled
+    u64 stormHoldNs;            // how long the meter is sampled after the next trip
+    u64 rearmTime;              // CLOCK_MONOTONIC ns the IRQ was enabled again
+    bool rearmPending;          // rearmWork hands the meter back to its IRQ, it is sampled until then
+    bool sampledEdge;           // the sampling counted an edge since the IRQ was disabled
+    unsigned int trips;         // times the storm guard disabled the IRQ
+    unsigned int switches;      // changes between IRQ and sampling in either direction
+    u32 exitWindowEdges;        // edges per window a sampled meter goes back below, 0 for half the limit
+    bool hybrid;                // go back to the IRQ after one calm window, without the hold time
+    int threadPriorityGen;      // the threadPriorityGen the IRQ thread runs with
+    struct irq_stats irqStats;  // filled in while irqStatsKey is on
+    u32 pulseWeight;            // thousandths of a unit per pulse
+    struct meter_demand demand;
+    struct meter_repeat repeat;
+    struct work_struct rearmWork;
+    struct kobject *kobj;
+    struct kernfs_node *counterDirent;
+    struct kernfs_node *lastTimeDirent;
+    char name[20];
+} ____cacheline_aligned;
+
+static struct ebox3_meter meters[METERS_NUM];
+static struct kobject *metersParent;   ///< /sys/ebox3/meters
+
+static void shed_meter(struct ebox3_meter *meter);     // ebox3shed.h
+static void notify_meter(struct ebox3_meter *meter);   // ebox3notify.h
+
+/**
+ * The bank sampler counts the meters whose IRQ is disabled. One hrtimer reads the inputs of all
+ * meters with a single gpiod array call, one register read per GPIO bank on controllers with
+ * get_multiple, and runs at the shortest samplePeriod of the sampled meters. While it counts a
+ * meter it holds bank_lock, a meter taken out of bankSampled under the lock is no longer written.
+ */
+static struct gpio_desc *meterInDescs[METERS_NUM];
+static unsigned long bankSampled = 0;       ///< The meters the bank sampler counts, bit 0 is m1
+static bool bankRunning = false;            ///< bankTimer is queued or running
+static struct hrtimer bankTimer;
+static DEFINE_SPINLOCK(bank_lock);
+
+/** @brief Hand a meter to the bank sampler, any context */
+static void bank_add(struct ebox3_meter *meter) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&bank_lock, flags);
+    bankSampled |= BIT(meter->id - 1);
+    if (!bankRunning) {
+        bankRunning = true;
+        hrtimer_start(&bankTimer, ns_to_ktime(READ_ONCE(meter->samplePeriodNs)), HRTIMER_MODE_REL);
+    }
+    spin_unlock_irqrestore(&bank_lock, flags);
+}
+
+/** @brief Take a meter from the bank sampler, it is not written by the sampler once this returns */
+static void bank_remove(struct ebox3_meter *meter) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&bank_lock, flags);
+    bankSampled &= ~BIT(meter->id - 1);
+    spin_unlock_irqrestore(&bank_lock, flags);
+}
+
+/** @brief Store a pulse timestamp in the meter ring, called from meter_count() only */
+static inline void meter_ring_push(struct ebox3_meter *meter, u64 timestamp) {
+    unsigned int head = meter->ringHead;
+
+    if (head - smp_load_acquire(&meter->ringTail) >= PULSE_RING_SIZE) {
+        meter->ringDropped++;
+        return;
+    }
+    meter->ring[head & (PULSE_RING_SIZE - 1)] = timestamp;
+    smp_store_release(&meter->ringHead, head + 1);
+}
+
+/** @brief Move up to max pulses out of the meter ring, the caller serializes the readers
+ *  @param meter the meter to drain
+ *  @param recs  the records to fill in
+ *  @param max   the number of records available at recs
+ *  @return returns the number of records filled in
+ */
+static unsigned int meter_ring_drain(struct ebox3_meter *meter, struct ebox3_pulse_record *recs, unsigned int max) {
+    unsigned int tail = meter->ringTail;
+    unsigned int avail = smp_load_acquire(&meter->ringHead) - tail;
+    unsigned int dropped = READ_ONCE(meter->ringDropped);
+    unsigned int i;
+
+    if (avail > max)
+        avail = max;
+    for (i = 0; i < avail; i++) {
+        recs[i].timestamp = meter->ring[(tail + i) & (PULSE_RING_SIZE - 1)];
+        recs[i].meter     = meter->id;
+        recs[i].dropped   = 0;
+    }
+    if (avail) {
+        // the losses happened after the last record handed out, report them on the first new one
+        recs[0].dropped = dropped - meter->ringDroppedSeen;
+        meter->ringDroppedSeen = dropped;
+        smp_store_release(&meter->ringTail, tail + avail);
+    }
+    return avail;
+}
+
+/** @brief Take a consistent copy of the counter and last pulse time of a meter
+ *  The IRQ handler never waits for the readers, a reader retries if a pulse came in meanwhile.
+ */
+static void meter_read(struct ebox3_meter *meter, u64 *pulses, u64 *lastTime) {
+    unsigned int seq;
+
+    do {
+        seq = read_seqcount_begin(&meter->seq);
+        *pulses   = meter->pulses;
+        *lastTime = meter->lastTime;
+    } while (read_seqcount_retry(&meter->seq, seq));
+}
+
+/** @brief Take a consistent copy of the rate of a meter */
+static void meter_read_rate(struct ebox3_meter *meter, struct meter_rate *rate) {
+    unsigned int seq;
+
+    do {
+        seq = read_seqcount_begin(&meter->seq);
+        *rate = meter->rate;
+    } while (read_seqcount_retry(&meter->seq, seq));
+}
+
+/** @brief Write the counter of a meter, the caller holds meter->lock
+ *  The relay gated counters restart with it, so they never count more than the counter.
+ */
+static void meter_store_pulses(struct ebox3_meter *meter, u64 pulses) {
+    write_seqcount_begin(&meter->seq);
+    meter->pulses = pulses;
+    memset(meter->gated, 0, sizeof(meter->gated));
+    write_seqcount_end(&meter->seq);
+    shared_meter_update(meter->id - 1, pulses, meter->lastTime);
+}
+
+/** @brief Replace the counter of a meter, any context
+ *  The exchange is atomic against the counting paths, a pulse is either in the value that is
+ *  returned or counted on top of the new one. The meter keeps counting meanwhile, a pulse that
+ *  comes in is held up for the exchange only.
+ *  @return returns the counter value that was replaced
+ */
+static u64 meter_set_pulses(struct ebox3_meter *meter, u64 pulses) {
+    unsigned long flags;
+    u64 old;
+
+    spin_lock_irqsave(&meter->lock, flags);
+    old = meter->pulses;
+    meter_store_pulses(meter, pulses);
+    spin_unlock_irqrestore(&meter->lock, flags);
+    irq_work_queue(&meter->notifyWork);
+    return old;
+}
+
+/** @brief Take a consistent copy of the interval statistics of a meter */
+static void meter_read_intervals(struct ebox3_meter *meter, struct meter_intervals *iv) {
+    unsigned int seq;
+
+    do {
+        seq = read_seqcount_begin(&meter->seq);
+        *iv = meter->intervals;
+    } while (read_seqcount_retry(&meter->seq, seq));
+}
+
+/** @brief Clear the interval statistics of a meter, any context */
+static void meter_reset_intervals(struct ebox3_meter *meter) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&meter->lock, flags);
+    write_seqcount_begin(&meter->seq);
+    memset(&meter->intervals, 0, sizeof(meter->intervals));
+    write_seqcount_end(&meter->seq);
+    spin_unlock_irqrestore(&meter->lock, flags);
+}
+
+#define SNAPSHOT_TRIES 8     // Lock-free snapshot attempts before the meter locks are taken
+
+static DEFINE_MUTEX(meters_mutex);     ///< Held while the locks of all meters are taken
+
+/** @brief Hold off the counting paths of all meters, process context only
+ *  The edges are still captured and sampled meanwhile, they are counted once meters_unlock()
+ *  lets go of the meters.
+ */
+static void meters_lock(void) {
+    unsigned int i;
+
+    mutex_lock(&meters_mutex);
+    local_irq_disable();
+    for (i = 0; i < METERS_NUM; i++)
+        spin_lock_nest_lock(&meters[i].lock, &meters_mutex);
+}
+
+static void meters_unlock(void) {
+    unsigned int i;
+
+    for (i = METERS_NUM; i--; )
+        spin_unlock(&meters[i].lock);
+    local_irq_enable();
+    mutex_unlock(&meters_mutex);
+}
+
+/** @brief Take a snapshot of all meters that were current at one instant
+ *  The counters are collected, the capture time is taken and the collection is validated
+ *  against the per-meter sequence counters. If no meter changed, every value was current at
+ *  the capture time. Under a pulse storm, or to reset counters, the copy is made under the locks
+ *  of all meters. Process context only.
+ *  @param snap receives METERS_NUM entries
+ *  @param gated receives the relay gated counters of every meter, may be NULL
+ *  @param onNs receives the on-times of the relays at the capture time, NULL along with gated
+ *  @param reset the meters whose counters restart from 0 in the same step, bit 0 is m1. A pulse
+ *  is either in the snapshot or counted after the reset.
+ *  @return returns the capture time in CLOCK_REALTIME nanoseconds
+ */
+static u64 meters_snapshot(struct ebox3_snapshot_meter *snap, u64 (*gated)[RELAYS_NUM], u64 *onNs,
+                           unsigned long reset) {
+    unsigned int seq[METERS_NUM];
+    unsigned int i, tries;
+    u64 captureTime;
+
+    for (tries = reset ? SNAPSHOT_TRIES : 0; tries < SNAPSHOT_TRIES; tries++) {
+        for (i = 0; i < METERS_NUM; i++) {
+            seq[i] = read_seqcount_begin(&meters[i].seq);
+            snap[i].counter  = meters[i].pulses;
+            snap[i].lastTime = meters[i].lastTime;
+            if (gated)
+                memcpy(gated[i], meters[i].gated, sizeof(gated[i]));
+        }
+        captureTime = ktime_get_real_ns();
+        if (onNs)
+            relays_read_on(onNs, ktime_get_ns());
+        for (i = 0; i < METERS_NUM; i++) {
+            if (read_seqcount_retry(&meters[i].seq, seq[i]))
+                break;
+        }
+        if (i == METERS_NUM)
+            return captureTime;
+    }
+
+    meters_lock();
+    for (i = 0; i < METERS_NUM; i++) {
+        snap[i].counter  = meters[i].pulses;
+        snap[i].lastTime = meters[i].lastTime;
+        if (gated)
+            memcpy(gated[i], meters[i].gated, sizeof(gated[i]));
+        if (reset & BIT(i))
+            meter_store_pulses(&meters[i], 0);
+    }
+    captureTime = ktime_get_real_ns();
+    if (onNs)
+        relays_read_on(onNs, ktime_get_ns());
+    meters_unlock();
+    for (i = 0; i < METERS_NUM; i++)
+        if (reset & BIT(i))
+            irq_work_queue(&meters[i].notifyWork);
+    return captureTime;
+}
+
+/** @brief Tell whether any meter ring holds a pulse that has not been read yet */
+static bool pulses_pending(void) {
+    unsigned int i;
+
+    for (i = 0; i < METERS_NUM; i++) {
+        if (smp_load_acquire(&meters[i].ringHead) != READ_ONCE(meters[i].ringTail))
+            return true;
+    }
+    return false;
+}
+
+/** @brief Find the meter that owns the /sys/ebox3/meters/mN kobject */
+static struct ebox3_meter *meter_from_kobj(struct kobject *kobj) {
+    unsigned int i;
+
+    for (i = 0; i < METERS_NUM; i++) {
+        if (meters[i].kobj == kobj)
+            return &meters[i];
+    }
+    return NULL;
+}
+
+static ssize_t counter_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    u64 pulses, lastTime;
+
+    if (!meter)
+        return -ENODEV;
+    meter_read(meter, &pulses, &lastTime);
+    return sprintf(buf, "%llu\n", pulses);
+}
+
+static ssize_t counter_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    u64 pulses;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%llu", &pulses) != 1)
+        return -EINVAL;
+    meter_set_pulses(meter, pulses);
+    return count;
+}
+
+static ssize_t lastTime_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    u64 pulses, lastTime;
+
+    if (!meter)
+        return -ENODEV;
+    meter_read(meter, &pulses, &lastTime);
+    return sprintf(buf, "%llu\n", div_u64(lastTime, NSEC_PER_SEC));
+}
+
+/** @brief Set the debounce time of a meter input
+ *  The debounce of the GPIO controller is used if it has one, else the edges are filtered by
+ *  meter_irq_handler(). A time of 0 turns the debounce off.
+ *  @param us the debounce time in microseconds
+ */
+static void meter_set_debounce(struct ebox3_meter *meter, unsigned int us) {
+    bool software = false;
+
+    if (gpio_set_debounce(meter->gpioIn, us) && us)
+        software = true;
+
+    WRITE_ONCE(meter->debounceNs, us * NSEC_PER_USEC);
+    WRITE_ONCE(meter->swDebounce, software);
+}
+
+/** @brief Displays the debounce time of the meter input in microseconds */
+static ssize_t debounce_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->debounceNs) / (u32)NSEC_PER_USEC);
+}
+
+static ssize_t debounce_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int us;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &us) != 1 || us > DEBOUNCE_MAX)
+        return -EINVAL;
+    meter_set_debounce(meter, us);
+    return count;
+}
+
+/** @brief Displays who debounces the meter input: off, hardware or software */
+static ssize_t debounceMode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    if (!READ_ONCE(meter->debounceNs))
+        return sprintf(buf, "off\n");
+    return sprintf(buf, "%s\n", READ_ONCE(meter->swDebounce) ? "software" : "hardware");
+}
+
+/** @brief Displays whether the software debounce confirms the input level before counting */
+static ssize_t confirm_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%d\n", READ_ONCE(meter->confirm));
+}
+
+static ssize_t confirm_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int confirm;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &confirm) != 1)
+        return -EINVAL;
+    WRITE_ONCE(meter->confirm, confirm != 0);
+    return count;
+}
+
+/** @brief Displays the number of edges the software debounce did not count */
+static ssize_t rejected_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->bounces) + READ_ONCE(meter->glitches));
+}
+
+/** @brief The pulse rate in Hz a sampling period counts exactly up to
+ *  Sampling misses pulses once they come in faster than one per two periods. A meter is only
+ *  sampled above its storm limit, the storm limit has to stay at or below this rate.
+ *  @param periodNs the sampling period in ns
+ */
+static u32 meter_sample_limit(u32 periodNs) {
+    return NSEC_PER_SEC / (2 * periodNs);
+}
+
+/** @brief Displays the edge rate in Hz above which the storm guard disables the IRQ, 0 is off */
+static ssize_t stormLimit_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->stormWindowEdges) * (u32)(NSEC_PER_SEC / STORM_WINDOW_NS));
+}
+
+static ssize_t stormLimit_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int hz;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &hz) != 1 || hz > meter_sample_limit(READ_ONCE(meter->samplePeriodNs)))
+        return -EINVAL;
+    WRITE_ONCE(meter->stormWindowEdges, hz / (u32)(NSEC_PER_SEC / STORM_WINDOW_NS));
+    return count;
+}
+
+/** @brief Displays the level sampling period of a tripped meter in microseconds */
+static ssize_t samplePeriod_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->samplePeriodNs) / (u32)NSEC_PER_USEC);
+}
+
+static ssize_t samplePeriod_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int us;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &us) != 1 || us < SAMPLE_PERIOD_MIN || us > DEBOUNCE_MAX)
+        return -EINVAL;
+    // the storm limit has to be lowered first for a longer period
+    if (READ_ONCE(meter->stormWindowEdges) * (u32)(NSEC_PER_SEC / STORM_WINDOW_NS) >
+        meter_sample_limit(us * NSEC_PER_USEC))
+        return -EINVAL;
+    WRITE_ONCE(meter->samplePeriodNs, us * NSEC_PER_USEC);
+    return count;
+}
+
+/** @brief Displays the pulse rate in Hz a sampled meter is counted exactly up to
+ *  Set by samplePeriod, pulses that come in faster than this while the meter is sampled are lost.
+ */
+static ssize_t sampleLimit_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", meter_sample_limit(READ_ONCE(meter->samplePeriodNs)));
+}
+
+/** @brief Displays how the meter is counted: irq, or sampling while its IRQ is held off */
+static ssize_t mode_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%s\n", READ_ONCE(meter->mode) == METER_SAMPLING ? "sampling" : "irq");
+}
+
+/** @brief Displays the number of times the storm guard disabled the IRQ */
+static ssize_t trips_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->trips));
+}
+
+/** @brief Displays the number of edges lost because the IRQ thread fell CAPTURE_SIZE edges behind */
+static ssize_t overruns_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->captureOverruns));
+}
+
+/** @brief Displays the pulse constant in units per pulse, the unit is up to the meter */
+static ssize_t pulseWeight_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    u32 weight;
+
+    if (!meter)
+        return -ENODEV;
+    weight = READ_ONCE(meter->pulseWeight);
+    return sprintf(buf, "%u.%03u\n", weight / 1000, weight % 1000);
+}
+
+/** @brief Sets the pulse constant in thousandths of a unit per pulse, 1 to PULSE_WEIGHT_MAX */
+static ssize_t pulseWeight_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int weight;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &weight) != 1)
+        return -EINVAL;
+    if (weight < 1 || weight > PULSE_WEIGHT_MAX)
+        return -ERANGE;
+    WRITE_ONCE(meter->pulseWeight, weight);
+    return count;
+}
+
+/** @brief Displays the rate from the last interval between two pulses in units per hour */
+static ssize_t rate_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    struct meter_rate rate;
+
+    if (!meter)
+        return -ENODEV;
+    meter_read_rate(meter, &rate);
+    return rate_show_units(buf, rate_value(&rate, ktime_get_ns(), false), READ_ONCE(meter->pulseWeight));
+}
+
+/** @brief Displays the smoothed rate in units per hour */
+static ssize_t rateAvg_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    struct meter_rate rate;
+
+    if (!meter)
+        return -ENODEV;
+    meter_read_rate(meter, &rate);
+    return rate_show_units(buf, rate_value(&rate, ktime_get_ns(), true), READ_ONCE(meter->pulseWeight));
+}
+
+/** @brief Displays the demand over the last window in units per hour */
+static ssize_t demand_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return demand_show_units(buf, &meter->demand, READ_ONCE(meter->demand.pulses), READ_ONCE(meter->pulseWeight));
+}
+
+/** @brief Displays the largest demand of a full window in units per hour, writing 0 resets it */
+static ssize_t demandMax_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return demand_show_units(buf, &meter->demand, READ_ONCE(meter->demand.maxPulses), READ_ONCE(meter->pulseWeight));
+}
+
+static ssize_t demandMax_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int value;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &value) != 1 || value != 0)
+        return -EINVAL;
+    mutex_lock(&demand_mutex);
+    hrtimer_cancel(&meter->demand.timer);
+    meter->demand.maxPulses = 0;
+    hrtimer_start(&meter->demand.timer, hrtimer_get_expires(&meter->demand.timer), HRTIMER_MODE_ABS);
+    mutex_unlock(&demand_mutex);
+    return count;
+}
+
+/** @brief Displays the demand window length in seconds */
+static ssize_t demandWindow_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->demand.windowSec));
+}
+
+/** @brief Sets the demand window length in seconds, the window starts over */
+static ssize_t demandWindow_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int windowSec;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &windowSec) != 1)
+        return -EINVAL;
+    if (windowSec < 1 || windowSec > 24 * 3600)
+        return -ERANGE;
+    mutex_lock(&demand_mutex);
+    hrtimer_cancel(&meter->demand.timer);
+    demand_start(&meter->demand, windowSec, meter->demand.subintervals);
+    mutex_unlock(&demand_mutex);
+    return count;
+}
+
+/** @brief Displays the number of subintervals the demand window slides by */
+static ssize_t demandSubintervals_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->demand.subintervals));
+}
+
+/** @brief Sets the number of subintervals of the demand window, 1 to DEMAND_BINS, the window starts over */
+static ssize_t demandSubintervals_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int subintervals;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &subintervals) != 1)
+        return -EINVAL;
+    if (subintervals < 1 || subintervals > DEMAND_BINS)
+        return -ERANGE;
+    mutex_lock(&demand_mutex);
+    hrtimer_cancel(&meter->demand.timer);
+    demand_start(&meter->demand, meter->demand.windowSec, subintervals);
+    mutex_unlock(&demand_mutex);
+    return count;
+}
+
+/** @brief Displays the repeater ratio, "<divide> <multiply>", divide 0 is off */
+static ssize_t repeatRatio_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u %u\n", READ_ONCE(meter->repeat.divide), READ_ONCE(meter->repeat.multiply));
+}
+
+/** @brief Sets the repeater ratio, multiply output pulses for every divide input pulses
+ *  "10 1" repeats every tenth pulse, "1 2" repeats every pulse twice and "0" turns it off.
+ */
+static ssize_t repeatRatio_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int divide, multiply = 1;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u %u", &divide, &multiply) < 1)
+        return -EINVAL;
+    if (divide > REPEAT_RATIO_MAX || multiply < 1 || multiply > REPEAT_RATIO_MAX)
+        return -ERANGE;
+    repeat_set_ratio(&meter->repeat, divide, multiply);
+    return count;
+}
+
+/** @brief Displays the width of the output pulses and the gaps between them in us */
+static ssize_t repeatWidth_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned long flags;
+    u64 width;
+
+    if (!meter)
+        return -ENODEV;
+    spin_lock_irqsave(&meter->repeat.lock, flags);
+    width = meter->repeat.widthNs;
+    spin_unlock_irqrestore(&meter->repeat.lock, flags);
+    return sprintf(buf, "%llu\n", div_u64(width, NSEC_PER_USEC));
+}
+
+/** @brief Sets the width of the output pulses in us, REPEAT_WIDTH_MIN to REPEAT_WIDTH_MAX */
+static ssize_t repeatWidth_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned long flags;
+    unsigned int us;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &us) != 1)
+        return -EINVAL;
+    if (us < REPEAT_WIDTH_MIN || us > REPEAT_WIDTH_MAX)
+        return -ERANGE;
+    spin_lock_irqsave(&meter->repeat.lock, flags);
+    meter->repeat.widthNs = (u64)us * NSEC_PER_USEC;
+    spin_unlock_irqrestore(&meter->repeat.lock, flags);
+    return count;
+}
+
+/** @brief Displays the output pulses waiting to be driven */
+static ssize_t repeatPending_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->repeat.pending));
+}
+
+/** @brief Displays the number of output pulses driven */
+static ssize_t repeatPulses_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned long flags;
+    u64 pulses;
+
+    if (!meter)
+        return -ENODEV;
+    spin_lock_irqsave(&meter->repeat.lock, flags);
+    pulses = meter->repeat.outPulses;
+    spin_unlock_irqrestore(&meter->repeat.lock, flags);
+    return sprintf(buf, "%llu\n", pulses);
+}
+
+/** @brief Displays the number of changes between irq and sampling mode */
+static ssize_t switches_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->switches));
+}
+
+/** @brief Displays the edge rate in Hz a sampled meter has to fall to before it goes back to its IRQ
+ *  0 is half the storm limit.
+ */
+static ssize_t exitLimit_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%u\n", READ_ONCE(meter->exitWindowEdges) * (u32)(NSEC_PER_SEC / STORM_WINDOW_NS));
+}
+
+static ssize_t exitLimit_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    unsigned int hz;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%u", &hz) != 1)
+        return -EINVAL;
+    WRITE_ONCE(meter->exitWindowEdges, hz / (u32)(NSEC_PER_SEC / STORM_WINDOW_NS));
+    return count;
+}
+
+/** @brief Displays whether the meter switches between irq and sampling mode by rate alone
+ *  In hybrid mode the stormLimit is the rate a meter is sampled above and exitLimit the rate it
+ *  goes back to its IRQ below, after a single calm window. Otherwise a tripped meter is held in
+ *  sampling mode for the storm guard hold time.
+ */
+static ssize_t hybrid_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+
+    if (!meter)
+        return -ENODEV;
+    return sprintf(buf, "%d\n", READ_ONCE(meter->hybrid));
+}
+
+static ssize_t hybrid_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct ebox3_meter *meter = meter_from_kobj(kobj);
+    int value;
+
+    if (!meter)
+        return -ENODEV;
+    if (sscanf(buf, "%d", &value) != 1)
+        return -EINVAL;
+    WRITE_ONCE(meter->hybrid, !!value);
+    return count;
+}
+
+static struct kobj_attribute meter_counter_attr  = __ATTR(counter, 0644, counter_show, counter_store);
+static struct kobj_attribute meter_lastTime_attr = __ATTR_RO(lastTime);
+static struct kobj_attribute meter_debounce_attr = __ATTR_RW(debounce);
+static struct kobj_attribute meter_debounceMode_attr = __ATTR_RO(debounceMode);
+static struct kobj_attribute meter_confirm_attr  = __ATTR_RW(confirm);
+static struct kobj_attribute meter_rejected_attr = __ATTR_RO(rejected);
+static struct kobj_attribute meter_stormLimit_attr = __ATTR_RW(stormLimit);
+static struct kobj_attribute meter_samplePeriod_attr = __ATTR_RW(samplePeriod);
+static struct kobj_attribute meter_sampleLimit_attr = __ATTR_RO(sampleLimit);
+static struct kobj_attribute meter_mode_attr     = __ATTR_RO(mode);
+static struct kobj_attribute meter_trips_attr    = __ATTR_RO(trips);
+static struct kobj_attribute meter_switches_attr = __ATTR_RO(switches);
+static struct kobj_attribute meter_exitLimit_attr = __ATTR_RW(exitLimit);
+static struct kobj_attribute meter_hybrid_attr   = __ATTR_RW(hybrid);
+static struct kobj_attribute meter_overruns_attr = __ATTR_RO(overruns);
+static struct kobj_attribute meter_pulseWeight_attr = __ATTR_RW(pulseWeight);
+static struct kobj_attribute meter_rate_attr     = __ATTR_RO(rate);
+static struct kobj_attribute meter_rateAvg_attr  = __ATTR_RO(rateAvg);
+static struct kobj_attribute meter_demand_attr   = __ATTR_RO(demand);
+static struct kobj_attribute meter_demandMax_attr = __ATTR_RW(demandMax);
+static struct kobj_attribute meter_demandWindow_attr = __ATTR_RW(demandWindow);
+static struct kobj_attribute meter_demandSubintervals_attr = __ATTR_RW(demandSubintervals);
+static struct kobj_attribute meter_repeatRatio_attr = __ATTR_RW(repeatRatio);
+static struct kobj_attribute meter_repeatWidth_attr = __ATTR_RW(repeatWidth);
+static struct kobj_attribute meter_repeatPending_attr = __ATTR_RO(repeatPending);
+static struct kobj_attribute meter_repeatPulses_attr = __ATTR_RO(repeatPulses);
+
+static struct attribute *meter_attrs[] = {
+    &meter_counter_attr.attr,
+    &meter_lastTime_attr.attr,
+    &meter_debounce_attr.attr,
+    &meter_debounceMode_attr.attr,
+    &meter_confirm_attr.attr,
+    &meter_rejected_attr.attr,
+    &meter_stormLimit_attr.attr,
+    &meter_samplePeriod_attr.attr,
+    &meter_sampleLimit_attr.attr,
+    &meter_mode_attr.attr,
+    &meter_trips_attr.attr,
+    &meter_switches_attr.attr,
+    &meter_exitLimit_attr.attr,
+    &meter_hybrid_attr.attr,
+    &meter_overruns_attr.attr,
+    &meter_pulseWeight_attr.attr,
+    &meter_rate_attr.attr,
+    &meter_rateAvg_attr.attr,
+    &meter_demand_attr.attr,
+    &meter_demandMax_attr.attr,
+    &meter_demandWindow_attr.attr,
+    &meter_demandSubintervals_attr.attr,
+    &meter_repeatRatio_attr.attr,
+    &meter_repeatWidth_attr.attr,
+    &meter_repeatPending_attr.attr,
+    &meter_repeatPulses_attr.attr,
+    NULL,
+};
+
+/**
+ * The same group is created on every /sys/ebox3/meters/mN kobject, the show/store
+ * callbacks find their meter through meter_from_kobj()
+ */
+static struct attribute_group meter_group = {
+    .attrs = meter_attrs,
+};
+
+/** @brief Wake up everybody waiting for a pulse of the meter and check its load shedding rules
+ *  and eventfds
+ *  Called once per run by the IRQ thread, so the pollers get a single wakeup for the burst of
+ *  pulses it counted, and from the irq_work the timers and process context queue.
+ *  Readers of the counter and lastTime attributes wait for it with poll() on POLLPRI|POLLERR.
+ */
+static void meter_notify(struct irq_work *work) {
+    struct ebox3_meter *meter = container_of(work, struct ebox3_meter, notifyWork);
+
+    shed_meter(meter);
+    notify_meter(meter);
+    events_wake();
+
+    sysfs_notify_dirent(meter->counterDirent);
+    sysfs_notify_dirent(meter->lastTimeDirent);
+    if (wq_has_sleeper(&pulses_wq))
+        wake_up_interruptible(&pulses_wq);
+}
+
+/** @brief Displays the snapshot of all meters, the capture time first and then a
+ *  "mN counter lastTime" line per meter, times in nanoseconds
+ */
+static ssize_t snapshot_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_snapshot_meter snap[METERS_NUM];
+    u64 captureTime = meters_snapshot(snap, NULL, NULL, 0);
+    ssize_t len;
+    unsigned int i;
+
+    len = sprintf(buf, "time %llu\n", captureTime);
+    for (i = 0; i < METERS_NUM; i++)
+        len += sprintf(buf + len, "m%u %llu %llu\n", meters[i].id, snap[i].counter, snap[i].lastTime);
+    return len;
+}
+
+/** @brief Displays the relay gated counters of all meters, taken at one instant
+ *  "time <ns>" first, then a "rN <ns>" line with the total on-time of every relay and a
+ *  "mN <counter> <r1> .. <rN>" line for every meter with the pulses counted while each relay
+ *  was on.
+ */
+static ssize_t gated_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct ebox3_snapshot_meter snap[METERS_NUM];
+    u64 gated[METERS_NUM][RELAYS_NUM];
+    u64 onNs[RELAYS_NUM];
+    u64 captureTime = meters_snapshot(snap, gated, onNs, 0);
+    ssize_t len;
+    unsigned int i, r;
+
+    len = sprintf(buf, "time %llu\n", captureTime);
+    for (r = 0; r < RELAYS_NUM; r++)
+        len += sprintf(buf + len, "r%u %llu\n", r + 1, onNs[r]);
+    for (i = 0; i < METERS_NUM; i++) {
+        len += sprintf(buf + len, "m%u %llu", meters[i].id, snap[i].counter);
+        for (r = 0; r < RELAYS_NUM; r++)
+            len += sprintf(buf + len, " %llu", gated[i][r]);
+        len += sprintf(buf + len, "\n");
+    }
+    return len;
+}
+
+/** @brief Reads the snapshot of all meters as struct ebox3_snapshot */
+static ssize_t snapshot_bin_read(struct file *filep, struct kobject *kobj, struct bin_attribute *attr,
+                                 char *buf, loff_t off, size_t count) {
+    struct {
+        struct ebox3_snapshot head;
+        struct ebox3_snapshot_meter meter[METERS_NUM];
+    } snap;
+
+    if (off >= sizeof(snap))
+        return 0;
+    if (count > sizeof(snap) - off)
+        count = sizeof(snap) - off;
+
+    snap.head.captureTime = meters_snapshot(snap.meter, NULL, NULL, 0);
+    snap.head.meters      = METERS_NUM;
+    snap.head.reserved    = 0;
+    memcpy(buf, (char *)&snap + off, count);
+    return count;
+}
+
+/** @brief Displays the SCHED_FIFO priority of the meter IRQ threads */
+static ssize_t threadPriority_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    return sprintf(buf, "%d\n", READ_ONCE(threadPriority));
+}
+
+/** @brief Sets the SCHED_FIFO priority of the meter IRQ threads, 1 to 99
+ *  Every thread applies it to itself on its next run.
+ */
+static ssize_t threadPriority_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    int value;
+
+    if (sscanf(buf, "%d", &value) != 1)
+        return -EINVAL;
+    if (value < 1 || value > MAX_USER_RT_PRIO - 1)
+        return -ERANGE;
+    WRITE_ONCE(threadPriority, value);
+    atomic_inc(&threadPriorityGen);
+    return count;
+}
+
+static struct kobj_attribute meters_snapshot_attr = __ATTR_RO(snapshot);
+static struct kobj_attribute meters_gated_attr = __ATTR_RO(gated);
+static struct kobj_attribute meters_threadPriority_attr = __ATTR(threadPriority, 0664, threadPriority_show, threadPriority_store);
+static struct bin_attribute meters_snapshot_bin_attr = __BIN_ATTR_RO(snapshot_bin,
+        sizeof(struct ebox3_snapshot) + METERS_NUM * sizeof(struct ebox3_snapshot_meter));
+
+static struct attribute *meters_attrs[] = {
+    &meters_snapshot_attr.attr,
+    &meters_gated_attr.attr,
+    &meters_threadPriority_attr.attr,
+    NULL,
+};
+
+static struct bin_attribute *meters_bin_attrs[] = {
+    &meters_snapshot_bin_attr,
+    NULL,
+};
+
+/** The attributes of /sys/ebox3/meters itself that cover all meters */
+static struct attribute_group meters_group = {
+    .attrs     = meters_attrs,
+    .bin_attrs = meters_bin_attrs,
+};
+
+/** @brief Count a pulse of the meter
+ *  Called by the IRQ thread, by confirmTimer while it owns the meter or by the storm guard
+ *  while the IRQ is disabled, never by two of them at once. meter->lock keeps the counter
+ *  resets out meanwhile. The caller notifies the pollers.
+ *  @param edge the CLOCK_MONOTONIC time of the edge in nanoseconds
+ */
+static void meter_count(struct ebox3_meter *meter, u64 edge) {
+    u64 lastTime = ktime_to_ns(ktime_mono_to_real(ns_to_ktime(edge)));
+    u32 relays = relays_state_at(edge);
+    unsigned long flags;
+    u64 interval, pulses;
+    unsigned int i;
+
+    spin_lock_irqsave(&meter->lock, flags);
+    write_seqcount_begin(&meter->seq);
+    pulses = ++meter->pulses;
+    meter->lastTime = lastTime;
+    for (i = 0; i < RELAYS_NUM; i++)
+        if (relays & BIT(i))
+            meter->gated[i]++;
+    interval = rate_pulse(&meter->rate, edge);
+    if (interval)
+        intervals_add(&meter->intervals, interval);
+    write_seqcount_end(&meter->seq);
+    atomic_inc(&meter->demand.count);
+    WRITE_ONCE(meter->notifyPulses, meter->notifyPulses + 1);
+    meter_ring_push(meter, edge);
+    shared_meter_update(meter->id - 1, pulses, lastTime);
+    spin_unlock_irqrestore(&meter->lock, flags);
+    events_push(EBOX3_EVENT_PULSE, meter->id, (u32)pulses, edge);
+    repeat_pulse(&meter->repeat);
+    // the level is read for the trace only, to tell an input that is still active from a short pulse
+    if (trace_ebox3_pulse_enabled())
+        trace_ebox3_pulse(meter->id, edge, gpio_get_value(meter->gpioIn));
+}
+
+/** @brief Count an IRQ in the storm guard rate window
+ *  @return returns true if the meter went over its edge rate limit
+ */
+static inline bool meter_storm(struct ebox3_meter *meter, u64 edge) {
+    u32 limit = READ_ONCE(meter->stormWindowEdges);
+
+    if (edge - meter->stormStart >= STORM_WINDOW_NS) {
+        meter->stormStart = edge;
+        meter->stormEdges = 0;
+    }
+    return limit && ++meter->stormEdges > limit;
+}
+
+/** @brief Hand a runaway meter over to level sampling, called by meter_irq_thread() only
+ *  The IRQ was disabled by the hard IRQ handler already. A meter that trips again soon after
+ *  its re-arm is sampled twice as long as the last time, a hybrid meter only for one window.
+ */
+static void meter_storm_trip(struct ebox3_meter *meter, u64 now) {
+    if (READ_ONCE(meter->hybrid))
+        meter->stormHoldNs = STORM_WINDOW_NS;
+    else if (now - meter->rearmTime > 2 * meter->stormHoldNs)
+        meter->stormHoldNs = STORM_HOLD_MIN_NS;
+    else
+        meter->stormHoldNs = min_t(u64, 2 * meter->stormHoldNs, STORM_HOLD_MAX_NS);
+    meter->sampleUntil = now + meter->stormHoldNs;
+    meter->sampleLevel = meter->activeLevel;    // the last captured edge was dealt with by the thread
+    meter->sampledEdge = false;
+    meter->stormStart  = now;
+    meter->stormEdges  = 0;
+    meter->trips++;
+    meter->switches++;
+    WRITE_ONCE(meter->mode, METER_SAMPLING);
+    bank_add(meter);
+}
+
+/** @brief Count a level change of a sampled meter, the caller holds bank_lock */
+static void meter_sample_level(struct ebox3_meter *meter, int level, u64 now) {
+    if (level == meter->sampleLevel)
+        return;
+    meter->sampleLevel = level;
+    if (level == meter->activeLevel) {
+        meter_count(meter, now);
+        irq_work_queue(&meter->notifyWork);
+        meter->sampledEdge = true;
+        meter->stormEdges++;
+    }
+}
+
+/** @brief Count a sample of a meter whose IRQ is disabled, called by bank_sample() only
+ *  Every change to the active level is counted as a pulse. Once the hold time is over and
+ *  the sampled rate is back below the exit limit, the IRQ is handed back by meter_rearm().
+ *  The meter is sampled until meter_rearm() has enabled the IRQ.
+ *  @param level the input level of the meter in the bank sample
+ */
+static void meter_sample(struct ebox3_meter *meter, int level, u64 now) {
+    // the level confirmation of the edge that tripped still owns the meter
+    if (smp_load_acquire(&meter->confirmPending))
+        return;
+
+    meter_sample_level(meter, level, now);
+    if (now - meter->stormStart >= STORM_WINDOW_NS) {
+        u32 exit = READ_ONCE(meter->exitWindowEdges);
+        bool calm = meter->stormEdges <= (exit ? exit : READ_ONCE(meter->stormWindowEdges) / 2);
+
+        meter->stormStart = now;
+        meter->stormEdges = 0;
+        // re-arm on an inactive level, the next edge is then a new pulse for the IRQ handler
+        if (calm && now >= meter->sampleUntil && level != meter->activeLevel && !meter->rearmPending) {
+            meter->rearmPending = true;
+            schedule_work(&meter->rearmWork);
+        }
+    }
+}
+
+/** @brief Sample the inputs of all meters at once and count the meters whose IRQ is disabled */
+static enum hrtimer_restart bank_sample(struct hrtimer *timer) {
+    DECLARE_BITMAP(levels, METERS_NUM);
+    u64 now = ktime_get_ns();
+    u32 period = U32_MAX;
+    enum hrtimer_restart restart = HRTIMER_NORESTART;
+    unsigned long flags;
+    unsigned int i;
+
+    spin_lock_irqsave(&bank_lock, flags);
+    if (bankSampled)
+        gpiod_get_raw_array_value(METERS_NUM, meterInDescs, NULL, levels);
+    for (i = 0; i < METERS_NUM; i++) {
+        if (!(bankSampled & BIT(i)))
+            continue;
+        meter_sample(&meters[i], test_bit(i, levels), now);
+        period = min(period, READ_ONCE(meters[i].samplePeriodNs));
+    }
+    if (bankSampled) {
+        hrtimer_forward_now(timer, ns_to_ktime(period));
+        restart = HRTIMER_RESTART;
+    } else {
+        bankRunning = false;
+    }
+    spin_unlock_irqrestore(&bank_lock, flags);
+    return restart;
+}
+
+/** @brief Hand a sampled meter back to its IRQ, process context
+ *  The last sample, enable_irq() and taking the meter from the sampler happen under bank_lock,
+ *  every edge is either sampled or raises the IRQ. The edges seen while the IRQ was disabled
+ *  make the IRQ core replay one IRQ on enable_irq(). The handler drops it with replayGuard if
+ *  the sampling counted an edge, otherwise it is an edge the sampling missed and is counted.
+ */
+static void meter_rearm(struct work_struct *work) {
+    struct ebox3_meter *meter = container_of(work, struct ebox3_meter, rearmWork);
+    unsigned long flags;
+    u64 now;
+
+    spin_lock_irqsave(&bank_lock, flags);
+    meter->rearmPending = false;
+    // taken from the sampler meanwhile by meter_exit()
+    if (!(bankSampled & BIT(meter->id - 1))) {
+        spin_unlock_irqrestore(&bank_lock, flags);
+        return;
+    }
+    now = ktime_get_ns();
+    meter_sample_level(meter, gpio_get_value(meter->gpioIn), now);
+
+    meter->rearmTime   = now;
+    meter->stormStart  = now;
+    meter->stormEdges  = 0;
+    meter->replayGuard = meter->sampledEdge;
+    meter->switches++;
+    WRITE_ONCE(meter->mode, METER_IRQ);
+    enable_irq(meter->irq);
+    bankSampled &= ~BIT(meter->id - 1);
+    spin_unlock_irqrestore(&bank_lock, flags);
+}
+
+/** @brief Count the edge held by the software debounce if the input level is still active */
+static enum hrtimer_restart meter_confirm(struct hrtimer *timer) {
+    struct ebox3_meter *meter = container_of(timer, struct ebox3_meter, confirmTimer);
+
+    if (gpio_get_value(meter->gpioIn) == meter->activeLevel) {
+        meter_count(meter, meter->confirmEdge);
+        irq_work_queue(&meter->notifyWork);
+    } else {
+        meter->glitches++;
+    }
+    smp_store_release(&meter->confirmPending, false);
+    return HRTIMER_NORESTART;
+}
+
+/** @brief Apply the scheduling priority set in threadPriority to the running IRQ thread */
+static void meter_thread_priority(struct ebox3_meter *meter) {
+    int gen = atomic_read(&threadPriorityGen);
+    struct sched_param param;
+
+    if (likely(meter->threadPriorityGen == gen))
+        return;
+    meter->threadPriorityGen = gen;
+    param.sched_priority = READ_ONCE(threadPriority);
+    sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
+}
+
+/** @brief Deal with one captured edge, called by meter_irq_thread() only
+ *  With the software debounce an edge closer than debounceNs to the last accepted one is a
+ *  bounce, a cheap timestamp comparison. In confirm mode an accepted edge is counted by
+ *  confirmTimer once the level held for debounceNs, edges are rejected until then.
+ *  @return returns true if the edge was counted
+ */
+static bool meter_edge(struct ebox3_meter *meter, u64 edge) {
+    if (unlikely(meter->replayGuard)) {
+        meter->replayGuard = false;
+        if (edge - meter->rearmTime < REPLAY_WINDOW_NS)
+            return false;
+    }
+
+    // confirmTimer counts from hard IRQ until it has checked the level, also if the software
+    // debounce was turned off meanwhile -- it must not be a second writer next to the thread
+    if (smp_load_acquire(&meter->confirmPending)) {
+        meter->bounces++;
+        return false;
+    }
+    if (READ_ONCE(meter->swDebounce)) {
+        u32 window = READ_ONCE(meter->debounceNs);
+
+        if (edge - meter->lastEdge < window) {
+            meter->bounces++;
+            return false;
+        }
+        meter->lastEdge = edge;
+        if (READ_ONCE(meter->confirm)) {
+            meter->confirmEdge = edge;
+            meter->confirmPending = true;
+            hrtimer_start(&meter->confirmTimer, ns_to_ktime(window), HRTIMER_MODE_REL);
+            return false;
+        }
+    }
+    meter_count(meter, edge);
+    return true;
+}
+
+/** @brief The meter IRQ handler, shared by all meters
+ *  Only the time of the edge is taken here and queued for meter_irq_thread(), and the storm
+ *  guard counts the IRQ. A runaway input has its IRQ disabled right away, the thread then
+ *  hands it over to level sampling.
+ *  @param irq    the IRQ number that is associated with the GPIO
+ *  @param dev_id the struct ebox3_meter that was passed to request_threaded_irq()
+ *  return returns IRQ_WAKE_THREAD
+ */
+static irqreturn_t meter_irq_handler(int irq, void *dev_id) {
+    struct ebox3_meter *meter = dev_id;
+    u64 edge = ktime_get_ns();
+    unsigned int head = meter->captureHead;
+
+    if (likely(head - smp_load_acquire(&meter->captureTail) < CAPTURE_SIZE)) {
+        meter->capture[head & (CAPTURE_SIZE - 1)] = edge;
+        smp_store_release(&meter->captureHead, head + 1);
+    } else {
+        meter->captureOverruns++;
+    }
+
+    if (unlikely(meter_storm(meter, edge))) {
+        disable_irq_nosync(irq);
+        WRITE_ONCE(meter->stormTripped, true);
+    }
+    if (static_branch_unlikely(&irqStatsKey))
+        irq_hist_add(&meter->irqStats.hardCost, ktime_get_ns() - edge);
+    return IRQ_WAKE_THREAD;
+}
+
+/** @brief The meter IRQ thread, shared by all meters
+ *  Debounces and counts the edges queued by meter_irq_handler() and wakes up the pollers once
+ *  for all of them.
+ *  @param irq    the IRQ number that is associated with the GPIO
+ *  @param dev_id the struct ebox3_meter that was passed to request_threaded_irq()
+ *  return returns IRQ_HANDLED
+ */
+static irqreturn_t meter_irq_thread(int irq, void *dev_id) {
+    struct ebox3_meter *meter = dev_id;
+    unsigned int tail = meter->captureTail;
+    unsigned int head;
+    bool counted = false, pushed = false, ok;
+    u64 start = 0, edge;
+
+    meter_thread_priority(meter);
+
+    if (static_branch_unlikely(&irqStatsKey)) {
+        start = ktime_get_ns();
+        if (smp_load_acquire(&meter->captureHead) != tail)
+            irq_hist_add(&meter->irqStats.wakeup, start - meter->capture[tail & (CAPTURE_SIZE - 1)]);
+    }
+
+    while ((head = smp_load_acquire(&meter->captureHead)) != tail) {
+        for (; tail != head; tail++) {
+            edge = meter->capture[tail & (CAPTURE_SIZE - 1)];
+            ok = meter_edge(meter, edge);
+            events_push(EBOX3_EVENT_EDGE, meter->id, ok, edge);
+            trace_ebox3_edge(meter->id, edge, ok);
+            counted |= ok;
+            pushed = true;
+        }
+        smp_store_release(&meter->captureTail, tail);
+    }
+    if (counted)
+        meter_notify(&meter->notifyWork);
+    else if (pushed)
+        events_wake();      // the edge events of bounces and glitches are read without a pulse
+
+    // the hard IRQ handler disabled the IRQ, no edge is queued behind the ones dealt with above
+    if (unlikely(READ_ONCE(meter->stormTripped))) {
+        WRITE_ONCE(meter->stormTripped, false);
+        meter_storm_trip(meter, ktime_get_ns());
+    }
+    if (start)
+        irq_hist_add(&meter->irqStats.threadCost, ktime_get_ns() - start);
+    return IRQ_HANDLED;
+}
+
+/** @brief Set up the GPIOs, sysfs entries and IRQ of one meter
+ *  @param meter    the meter to set up, id/gpioIn/gpioOut must be filled in
+ *  @param parent   the /sys/ebox3/meters kobject
+ *  @param IRQflags the IRQ trigger flags
+ *  @return returns 0 if successful
+ */
+static int meter_init(struct ebox3_meter *meter, struct kobject *parent, unsigned long IRQflags) {
+    char kobjName[8];
+    int result;
+
+    snprintf(kobjName, sizeof(kobjName), "m%u", meter->id);
+    meter->kobj = kobject_create_and_add(kobjName, parent);
+    if (!meter->kobj) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to create kobject for meter%u\n", meter->id);
+        return -ENOMEM;
+    }
+    result = sysfs_create_group(meter->kobj, &meter_group);
+    if (result) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meter%u\n", meter->id);
+        kobject_put(meter->kobj);
+        return result;
+    }
+    // sysfs_notify() may sleep, look up the attributes once for sysfs_notify_dirent()
+    meter->counterDirent  = sysfs_get_dirent(meter->kobj->sd, "counter");
+    meter->lastTimeDirent = sysfs_get_dirent(meter->kobj->sd, "lastTime");
+    if (!meter->counterDirent || !meter->lastTimeDirent) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to find sysfs attributes of meter%u\n", meter->id);
+        sysfs_put(meter->counterDirent);
+        sysfs_put(meter->lastTimeDirent);
+        kobject_put(meter->kobj);
+        return -ENODEV;
+    }
+    init_irq_work(&meter->notifyWork, meter_notify);
+
+    // Set up the Meter Output to HIGH = 1
+    gpio_request(meter->gpioOut, "sysfs");
+    gpio_direction_output(meter->gpioOut, REPEAT_IDLE);
+    gpio_export(meter->gpioOut, false);
+    repeat_init(&meter->repeat, meter->gpioOut);
+
+    gpio_request(meter->gpioIn, "sysfs");
+    gpio_direction_input(meter->gpioIn);
+    gpio_export(meter->gpioIn, false);
+
+    hrtimer_init(&meter->confirmTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    meter->confirmTimer.function = meter_confirm;
+    meter->activeLevel = (IRQflags & IRQF_TRIGGER_FALLING) ? 0 : 1;
+    meter_set_debounce(meter, DEBOUNCE_TIME);
+
+    INIT_WORK(&meter->rearmWork, meter_rearm);
+    meter->mode             = METER_IRQ;
+    meter->samplePeriodNs   = SAMPLE_PERIOD * NSEC_PER_USEC;
+    meter->stormWindowEdges = STORM_LIMIT / (NSEC_PER_SEC / STORM_WINDOW_NS);
+    meter->stormHoldNs      = STORM_HOLD_MIN_NS;
+    meter->pulseWeight      = PULSE_WEIGHT;
+    demand_init(&meter->demand);
+
+    // set the last time to be the current time
+    meter->lastTime = ktime_get_real_ns();
+    shared_meter_update(meter->id - 1, meter->pulses, meter->lastTime);
+
+    // GPIO numbers and IRQ numbers are not the same! This function performs the mapping for us
+    meter->irq = gpio_to_irq(meter->gpioIn);
+    printk(KERN_INFO "Ebox3 Driver: The meter%u is mapped to IRQ: %d\n", meter->id, meter->irq);
+
+    snprintf(meter->name, sizeof(meter->name), "meter_handler_%u", meter->id);
+    result = request_threaded_irq(meter->irq, meter_irq_handler, meter_irq_thread, IRQflags, meter->name, meter);
+    if (result) {
+        demand_exit(&meter->demand);
+        gpio_unexport(meter->gpioIn);
+        gpio_free(meter->gpioIn);
+        gpio_set_value(meter->gpioOut, 0);
+        gpio_unexport(meter->gpioOut);
+        gpio_free(meter->gpioOut);
+        sysfs_put(meter->counterDirent);
+        sysfs_put(meter->lastTimeDirent);
+        kobject_put(meter->kobj);
+    }
+    return result;
+}
+
+static void meter_exit(struct ebox3_meter *meter) {
+    // stop the storm guard first, a re-arm must not enable the IRQ once it is freed
+    disable_irq(meter->irq);
+    bank_remove(meter);
+    cancel_work_sync(&meter->rearmWork);
+    free_irq(meter->irq, meter);
+    hrtimer_cancel(&meter->confirmTimer);
+    irq_work_sync(&meter->notifyWork);
+    demand_exit(&meter->demand);
+    repeat_exit(&meter->repeat);
+
+    gpio_set_value(meter->gpioOut, 0);
+    gpio_unexport(meter->gpioOut);
+    gpio_free(meter->gpioOut);
+
+    gpio_unexport(meter->gpioIn);
+    gpio_free(meter->gpioIn);
+
+    sysfs_put(meter->counterDirent);
+    sysfs_put(meter->lastTimeDirent);
+    kobject_put(meter->kobj);
+}
+
+/** @brief Set up every meter of the meter_pins table
+ *  @param parent   the /sys/ebox3/meters kobject
+ *  @param IRQflags the IRQ trigger flags
+ *  @return returns 0 if successful, on failure the meters set up so far are released
+ */
+static int meters_init(struct kobject *parent, unsigned long IRQflags) {
+    unsigned int i;
+    int result;
+
+    // the bank sampler reads all inputs, also those of meters that are not set up yet
+    for (i = 0; i < METERS_NUM; i++)
+        meterInDescs[i] = gpio_to_desc(meter_pins[i].gpioIn);
+    hrtimer_init(&bankTimer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    bankTimer.function = bank_sample;
+
+    for (i = 0; i < METERS_NUM; i++) {
+        meters[i].id      = i + 1;
+        meters[i].gpioIn  = meter_pins[i].gpioIn;
+        meters[i].gpioOut = meter_pins[i].gpioOut;
+        meters[i].ring    = meter_ring[i];
+        meters[i].capture = meter_capture[i];
+        spin_lock_init(&meters[i].lock);
+        seqcount_init(&meters[i].seq);
+
+        result = meter_init(&meters[i], parent, IRQflags);
+        if (result) {
+            printk(KERN_ALERT "Ebox3 Driver: failed to init meter%u\n", meters[i].id);
+            while (i--)
+                meter_exit(&meters[i]);
+            hrtimer_cancel(&bankTimer);
+            return result;
+        }
+    }
+
+    // add the attributes that cover all meters to /sys/ebox3/meters
+    result = sysfs_create_group(parent, &meters_group);
+    if (result) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for meters\n");
+        for (i = 0; i < METERS_NUM; i++)
+            meter_exit(&meters[i]);
+        hrtimer_cancel(&bankTimer);
+        return result;
+    }
+    metersParent = parent;
+    return 0;
+}
+
+static void meters_exit(void) {
+    unsigned int i;
+
+    sysfs_remove_group(metersParent, &meters_group);
+    for (i = 0; i < METERS_NUM; i++)
+        meter_exit(&meters[i]);
+    hrtimer_cancel(&bankTimer);
+}
@@ -0,0 +1,160 @@
+#include <linux/kernel.h>
+#include <linux/eventfd.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include "ebox3uapi.h"
+
+#define NOTIFY_SLOTS        16          // Eventfds that can be registered at once, on all meters
+#define NOTIFY_INTERVAL_MAX 3600000     // The longest time between two signals - 1h
+
+/**
+ * An eventfd registered on a meter through EBOX3_IOC_NOTIFY. It is signalled from the notify
+ * path of the meter once every pulses came in since the last signal and intervalNs passed since
+ * then, so a consumer of a fast meter wakes up once per batch instead of once per pulse. Pulses
+ * held back by intervalNs are signalled by timer when it runs out, none is left waiting for the
+ * next pulse. Each signal adds the pulses since the last one to the eventfd counter.
+ */
+struct notify_slot {
+    struct eventfd_ctx *ctx;    // NULL while the slot is free
+    struct file *owner;         // the /dev/ebox3ctl file that registered it
+    unsigned int meter;         // index into meters[], 0 is m1
+    u32 every;                  // pulses per signal, at least 1
+    u64 intervalNs;             // least time between two signals, 0 for no limit
+    u32 seen;                   // notifyPulses of the meter at the last signal
+    u64 signalled;              // CLOCK_MONOTONIC ns of the last signal
+    struct hrtimer timer;       // signals the pulses held back by intervalNs
+};
+
+static struct notify_slot notifySlots[NOTIFY_SLOTS];
+static unsigned int notifyCount = 0;        ///< Slots in use, 0 keeps the pulse path out of here
+static DEFINE_SPINLOCK(notify_lock);        ///< Protects the slots against the pulse path
+static DEFINE_MUTEX(notify_mutex);          ///< Serializes the registrations
+
+/** @brief Signal the eventfd of a slot if its policy is met, the caller holds notify_lock */
+static void notify_slot_check(struct notify_slot *slot, u64 now) {
+    u32 n = READ_ONCE(meters[slot->meter].notifyPulses) - slot->seen;
+
+    if (n == 0 || n < slot->every)
+        return;
+    if (slot->intervalNs && now - slot->signalled < slot->intervalNs) {
+        if (!hrtimer_is_queued(&slot->timer))
+            hrtimer_start(&slot->timer, ns_to_ktime(slot->signalled + slot->intervalNs), HRTIMER_MODE_ABS);
+        return;
+    }
+    eventfd_signal(slot->ctx, n);
+    slot->seen     += n;
+    slot->signalled = now;
+}
+
+static enum hrtimer_restart notify_timer(struct hrtimer *timer) {
+    struct notify_slot *slot = container_of(timer, struct notify_slot, timer);
+    unsigned long flags;
+
+    spin_lock_irqsave(&notify_lock, flags);
+    if (slot->ctx)
+        notify_slot_check(slot, ktime_get_ns());
+    spin_unlock_irqrestore(&notify_lock, flags);
+    return HRTIMER_NORESTART;
+}
+
+/** @brief Signal the eventfds of a meter whose policy is met, called by meter_notify() */
+static void notify_meter(struct ebox3_meter *meter) {
+    unsigned int i, index = meter - meters;
+    unsigned long flags;
+    u64 now;
+
+    if (!READ_ONCE(notifyCount))
+        return;
+
+    now = ktime_get_ns();
+    spin_lock_irqsave(&notify_lock, flags);
+    for (i = 0; i < NOTIFY_SLOTS; i++)
+        if (notifySlots[i].ctx && notifySlots[i].meter == index)
+            notify_slot_check(&notifySlots[i], now);
+    spin_unlock_irqrestore(&notify_lock, flags);
+}
+
+/** @brief Free a slot and drop its eventfd, the caller holds notify_mutex */
+static void notify_drop(struct notify_slot *slot) {
+    struct eventfd_ctx *ctx;
+    unsigned long flags;
+
+    spin_lock_irqsave(&notify_lock, flags);
+    ctx = slot->ctx;
+    slot->ctx   = NULL;
+    slot->owner = NULL;
+    WRITE_ONCE(notifyCount, notifyCount - 1);
+    spin_unlock_irqrestore(&notify_lock, flags);
+    hrtimer_cancel(&slot->timer);
+    eventfd_ctx_put(ctx);
+}
+
+/** @brief Register, replace or drop the eventfd of a file on a meter
+ *  @param owner the /dev/ebox3ctl file the eventfd goes away with
+ *  @param req a checked request, see EBOX3_IOC_NOTIFY
+ *  @return returns 0 if successful
+ */
+static int notify_set(struct file *owner, const struct ebox3_notify *req) {
+    struct notify_slot *slot = NULL;
+    struct eventfd_ctx *ctx = NULL;
+    unsigned long flags;
+    unsigned int i;
+
+    if (req->fd >= 0) {
+        ctx = eventfd_ctx_fdget(req->fd);
+        if (IS_ERR(ctx))
+            return PTR_ERR(ctx);
+    }
+
+    mutex_lock(&notify_mutex);
+    for (i = 0; i < NOTIFY_SLOTS; i++) {
+        if (notifySlots[i].owner == owner && notifySlots[i].meter == req->meter - 1) {
+            notify_drop(&notifySlots[i]);
+            if (!ctx) {
+                mutex_unlock(&notify_mutex);
+                return 0;
+            }
+        }
+    }
+    if (!ctx) {
+        mutex_unlock(&notify_mutex);
+        return -ENOENT;
+    }
+
+    for (i = 0; i < NOTIFY_SLOTS && !slot; i++)
+        if (!notifySlots[i].ctx)
+            slot = &notifySlots[i];
+    if (!slot) {
+        mutex_unlock(&notify_mutex);
+        eventfd_ctx_put(ctx);
+        return -EBUSY;
+    }
+    hrtimer_init(&slot->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    slot->timer.function = notify_timer;
+
+    spin_lock_irqsave(&notify_lock, flags);
+    slot->owner      = owner;
+    slot->meter      = req->meter - 1;
+    slot->every      = max(req->every, 1U);
+    slot->intervalNs = (u64)req->intervalMs * NSEC_PER_MSEC;
+    slot->seen       = READ_ONCE(meters[slot->meter].notifyPulses);
+    slot->signalled  = 0;
+    slot->ctx        = ctx;
+    WRITE_ONCE(notifyCount, notifyCount + 1);
+    spin_unlock_irqrestore(&notify_lock, flags);
+    mutex_unlock(&notify_mutex);
+    return 0;
+}
+
+/** @brief Drop all eventfds a file registered, called when /dev/ebox3ctl is closed */
+static void notify_release(struct file *owner) {
+    unsigned int i;
+
+    mutex_lock(&notify_mutex);
+    for (i = 0; i < NOTIFY_SLOTS; i++)
+        if (notifySlots[i].owner == owner)
+            notify_drop(&notifySlots[i]);
+    mutex_unlock(&notify_mutex);
+}
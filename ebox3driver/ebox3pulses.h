@@ -0,0 +1,105 @@
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+
+#define  PULSES_DEVICE_NAME "ebox3pulses"   ///< The device will appear at /dev/ebox3pulses
+#define  PULSES_CHUNK       256             ///< Records moved to user space per copy_to_user()
+
+static int    pulsesMajor;                  ///< Stores the device number -- determined automatically
+static struct device *pulsesDevice = NULL;  ///< The device-driver device struct pointer
+
+static DEFINE_MUTEX(pulses_mutex);          ///< Serializes the readers, the rings have a single consumer
+static unsigned int pulsesNext = 0;         ///< The ring the next chunk is taken from -- protected by pulses_mutex
+
+/** @brief Drain the pulse rings of all meters into the user buffer
+ *  The read blocks until at least one pulse is available unless O_NONBLOCK is set and then
+ *  returns as many whole struct ebox3_pulse_record as fit in the buffer. The rings are taken
+ *  a chunk at a time in turn, also across reads, so a fast meter does not hold the others back
+ *  until their rings overrun.
+ *  @param filep A pointer to a file object
+ *  @param buffer The user buffer, its length should be a multiple of the record size
+ *  @param len The length of the buffer
+ *  @param offset Not used, the device is a stream
+ */
+static ssize_t pulses_read(struct file *filep, char __user *buffer, size_t len, loff_t *offset) {
+    static struct ebox3_pulse_record recs[PULSES_CHUNK];    // protected by pulses_mutex
+    size_t max = len / sizeof(struct ebox3_pulse_record);
+    size_t done = 0;
+    unsigned int i, n;
+    bool drained;
+    int result;
+
+    if (max == 0)
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&pulses_mutex))
+        return -ERESTARTSYS;
+
+    for (;;) {
+        do {
+            drained = false;
+            for (i = 0; i < METERS_NUM && done < max; i++) {
+                n = meter_ring_drain(&meters[pulsesNext], recs, min_t(size_t, max - done, PULSES_CHUNK));
+                pulsesNext = (pulsesNext + 1) % METERS_NUM;
+                if (n == 0)
+                    continue;
+                if (copy_to_user(buffer + done * sizeof(recs[0]), recs, n * sizeof(recs[0]))) {
+                    mutex_unlock(&pulses_mutex);
+                    return -EFAULT;
+                }
+                done += n;
+                drained = true;
+            }
+        } while (drained && done < max);
+        if (done || (filep->f_flags & O_NONBLOCK))
+            break;
+
+        // nothing buffered yet -- sleep until the IRQ handler pushes a pulse
+        mutex_unlock(&pulses_mutex);
+        result = wait_event_interruptible(pulses_wq, pulses_pending());
+        if (result)
+            return result;
+        if (mutex_lock_interruptible(&pulses_mutex))
+            return -ERESTARTSYS;
+    }
+    mutex_unlock(&pulses_mutex);
+
+    if (done == 0)
+        return -EAGAIN;
+    return done * sizeof(struct ebox3_pulse_record);
+}
+
+static const struct file_operations pulses_fops = {
+    .owner  = THIS_MODULE,
+    .open   = nonseekable_open,
+    .read   = pulses_read,
+    .llseek = no_llseek,
+};
+
+/** @brief Register /dev/ebox3pulses
+ *  @param cls the ebox3 device class
+ *  @return returns 0 if successful
+ */
+static int pulses_init(struct class *cls) {
+    pulsesMajor = register_chrdev(0, PULSES_DEVICE_NAME, &pulses_fops);
+    if (pulsesMajor < 0) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to register a major number for %s\n", PULSES_DEVICE_NAME);
+        return pulsesMajor;
+    }
+
+    pulsesDevice = device_create(cls, NULL, MKDEV(pulsesMajor, 0), NULL, PULSES_DEVICE_NAME);
+    if (IS_ERR(pulsesDevice)) {
+        unregister_chrdev(pulsesMajor, PULSES_DEVICE_NAME);
+        printk(KERN_ALERT "Ebox3 Driver: failed to create the %s device\n", PULSES_DEVICE_NAME);
+        return PTR_ERR(pulsesDevice);
+    }
+    return 0;
+}
+
+static void pulses_exit(struct class *cls) {
+    device_destroy(cls, MKDEV(pulsesMajor, 0));
+    unregister_chrdev(pulsesMajor, PULSES_DEVICE_NAME);
+}
@@ -0,0 +1,187 @@
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/atomic.h>
+#include <linux/mutex.h>
+#include <linux/hrtimer.h>
+
+#define PULSE_WEIGHT        1000    // The default pulse constant -- 1.000 unit per pulse, e.g. 1 Wh
+#define PULSE_WEIGHT_MAX    1000000 // 1000 units per pulse keeps the rate math within 64 bits
+#define RATE_EWMA_SHIFT     3       // The smoothed rate moves 1/8 of the way to every new rate
+#define DEMAND_WINDOW       900     // The default demand window -- 15 minutes
+#define DEMAND_SUBINTERVALS 15      // The default number of subintervals the window slides by
+#define DEMAND_BINS         60      // The most subintervals a window can have
+
+#define INTERVAL_BUCKETS    32      // log2 buckets of 1024 ns, the last one takes everything longer
+#define MILLI_PULSES_HOUR   (3600ULL * NSEC_PER_SEC * 1000)    // 1000 * ns per hour
+
+/**
+ * Rates are kept in milli-pulses per hour and converted to engineering units with the pulse
+ * constant only when they are displayed, so a change of the constant applies to them at once.
+ * A meter counting Wh with a constant of 1000 (1 Wh per pulse) shows its rates in W.
+ */
+struct meter_rate {
+    u64 lastPulse;      // CLOCK_MONOTONIC ns of the last pulse, 0 before the first one
+    u64 interval;       // ns between the last two pulses, 0 before the second one
+    u64 avgScaled;      // the smoothed rate << RATE_EWMA_SHIFT
+};
+
+/**
+ * The demand is the average rate over a window that slides by one subinterval at a time.
+ * The subintervals are aligned to the wall clock, so a 15 minute window with 15 subintervals
+ * closes on every full minute. The timer is the only writer of everything but count.
+ */
+struct meter_demand {
+    atomic_t count;             // pulses of the running subinterval
+    u32 bins[DEMAND_BINS];      // pulses of the last closed subintervals
+    u32 sum;                    // sum of bins[]
+    unsigned int next;          // the bin the running subinterval goes to
+    unsigned int filled;        // closed subintervals since the start, up to subintervals
+    unsigned int windowSec;
+    unsigned int subintervals;
+    u64 subintervalNs;
+    bool partial;               // the running subinterval started in the middle, ignore it
+    u32 pulses;                 // pulses per window, extrapolated while the window fills up
+    u32 maxPulses;              // the largest pulses of a full window
+    struct hrtimer timer;
+};
+
+/**
+ * The distribution of the intervals between pulses. Bucket 0 counts the intervals shorter than
+ * 1024 ns and bucket n those from 2^(n-1) to 2^n times 1024 ns.
+ */
+struct meter_intervals {
+    u64 count;
+    u64 sum;            // ns, for the mean
+    u64 min;
+    u64 max;
+    u32 bucket[INTERVAL_BUCKETS];
+};
+
+static DEFINE_MUTEX(demand_mutex);  ///< Serializes the changes of the demand settings
+
+/** @brief Account a pulse in the rate, called by meter_count() only
+ *  @param edge the CLOCK_MONOTONIC time of the pulse in nanoseconds
+ *  @return returns the interval to the previous pulse in nanoseconds, 0 for the first pulse
+ */
+static inline u64 rate_pulse(struct meter_rate *rate, u64 edge) {
+    u64 mph, interval = 0;
+
+    if (rate->lastPulse && edge > rate->lastPulse) {
+        interval = rate->interval = edge - rate->lastPulse;
+        mph = div64_u64(MILLI_PULSES_HOUR, rate->interval);
+        if (rate->avgScaled)
+            rate->avgScaled += mph - (rate->avgScaled >> RATE_EWMA_SHIFT);
+        else
+            rate->avgScaled = mph << RATE_EWMA_SHIFT;
+    }
+    rate->lastPulse = edge;
+    return interval;
+}
+
+/** @brief Account an interval between two pulses, called by meter_count() only */
+static inline void intervals_add(struct meter_intervals *iv, u64 interval) {
+    unsigned int b = fls64(interval >> 10);
+
+    iv->bucket[min_t(unsigned int, b, INTERVAL_BUCKETS - 1)]++;
+    if (!iv->count++ || interval < iv->min)
+        iv->min = interval;
+    if (interval > iv->max)
+        iv->max = interval;
+    iv->sum += interval;
+}
+
+/** @brief The rate of a meter in milli-pulses per hour
+ *  A meter that stopped pulsing can not be faster than one pulse in the time since its last
+ *  pulse, so the rates fall off when no pulses come in.
+ *  @param rate a consistent copy of the meter rate
+ *  @param now the current CLOCK_MONOTONIC time in nanoseconds
+ *  @param smoothed whether to return the smoothed rate instead of the last interval one
+ */
+static u64 rate_value(const struct meter_rate *rate, u64 now, bool smoothed) {
+    u64 bound, value;
+
+    if (!rate->interval)
+        return 0;
+    bound = div64_u64(MILLI_PULSES_HOUR, max(rate->interval, now - rate->lastPulse));
+    value = smoothed ? rate->avgScaled >> RATE_EWMA_SHIFT : bound;
+    return min(value, bound);
+}
+
+/** @brief Displays milli-pulses per hour in units per hour with three decimals
+ *  @param weight the pulse constant in thousandths of a unit
+ */
+static ssize_t rate_show_units(char *buf, u64 mph, u32 weight) {
+    u32 rem;
+    u64 units = div_u64_rem(div_u64(mph * weight, 1000), 1000, &rem);
+
+    return sprintf(buf, "%llu.%03u\n", units, rem);
+}
+
+/** @brief Close the running subinterval and slide the demand window */
+static enum hrtimer_restart demand_timer(struct hrtimer *timer) {
+    struct meter_demand *demand = container_of(timer, struct meter_demand, timer);
+    u32 count = atomic_xchg(&demand->count, 0);
+
+    hrtimer_forward_now(timer, ns_to_ktime(demand->subintervalNs));
+    if (demand->partial) {
+        demand->partial = false;
+        return HRTIMER_RESTART;
+    }
+
+    demand->sum -= demand->bins[demand->next];
+    demand->bins[demand->next] = count;
+    demand->sum += count;
+    if (++demand->next == demand->subintervals)
+        demand->next = 0;
+    if (demand->filled < demand->subintervals)
+        demand->filled++;
+
+    WRITE_ONCE(demand->pulses, div_u64((u64)demand->sum * demand->subintervals, demand->filled));
+    if (demand->filled == demand->subintervals && demand->sum > demand->maxPulses)
+        WRITE_ONCE(demand->maxPulses, demand->sum);
+    return HRTIMER_RESTART;
+}
+
+/** @brief Start the demand window over, the caller holds demand_mutex and the timer is stopped
+ *  @param windowSec the window length in seconds
+ *  @param subintervals the number of subintervals in the window, 1 to DEMAND_BINS
+ */
+static void demand_start(struct meter_demand *demand, unsigned int windowSec, unsigned int subintervals) {
+    u64 now = ktime_get_real_ns();
+    u64 first;
+
+    memset(demand->bins, 0, sizeof(demand->bins));
+    demand->sum          = 0;
+    demand->next         = 0;
+    demand->filled       = 0;
+    demand->windowSec    = windowSec;
+    demand->subintervals = subintervals;
+    demand->subintervalNs = div_u64((u64)windowSec * NSEC_PER_SEC, subintervals);
+    demand->partial      = true;
+    WRITE_ONCE(demand->pulses, 0);
+
+    // the first subinterval ends on the next wall clock multiple of the subinterval length
+    first = (div64_u64(now, demand->subintervalNs) + 1) * demand->subintervalNs;
+    hrtimer_start(&demand->timer, ns_to_ktime(first), HRTIMER_MODE_ABS);
+}
+
+static void demand_init(struct meter_demand *demand) {
+    atomic_set(&demand->count, 0);
+    demand->maxPulses = 0;
+    hrtimer_init(&demand->timer, CLOCK_REALTIME, HRTIMER_MODE_ABS);
+    demand->timer.function = demand_timer;
+    mutex_lock(&demand_mutex);
+    demand_start(demand, DEMAND_WINDOW, DEMAND_SUBINTERVALS);
+    mutex_unlock(&demand_mutex);
+}
+
+static void demand_exit(struct meter_demand *demand) {
+    hrtimer_cancel(&demand->timer);
+}
+
+/** @brief Displays pulses per window as a demand in units per hour with three decimals
+ *  @param weight the pulse constant in thousandths of a unit
+ */
+static ssize_t demand_show_units(char *buf, const struct meter_demand *demand, u32 pulses, u32 weight) {
+    return rate_show_units(buf, div_u64((u64)pulses * 3600 * 1000, demand->windowSec), weight);
+}
@@ -1,16 +1,232 @@
 #include <linux/kernel.h>
 #include <linux/gpio.h>
+#include <linux/gpio/consumer.h>
 #include <linux/kobject.h>
+#include <linux/spinlock.h>
+#include <linux/bitmap.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/seqlock.h>
+#include "ebox3uapi.h"
 
-static unsigned int gpioRelay1 = 69;
-static unsigned int gpioRelay2 = 68;
-static unsigned int gpioRelay3 = 67;
-static unsigned int gpioRelay4 = 66;
+/**
+ * The relay GPIOs -- r1 is the first entry and bit 0 of every relay mask.
+ */
+static unsigned int gpioRelays[] = { 69, 68, 67, 66 };
+
+#define RELAYS_NUM ARRAY_SIZE(gpioRelays)
+#define RELAYS_ALL (BIT(RELAYS_NUM) - 1)
+
+static struct gpio_desc *relayDescs[RELAYS_NUM];
+static unsigned long relayState = 0;        ///< The shadow state, bit 0 is r1 -- written under relays_lock
+static DEFINE_SPINLOCK(relays_lock);        ///< Serializes the relay writers, they may run from timers
+
+/**
+ * The switching scheduler. Requests change relayTarget, the relays follow it as far as the
+ * minimum on/off dwell times and the spacing between two closes allow, the rest is deferred to
+ * switchTimer. With all limits at 0, the default, every request switches at once.
+ * Everything in here is written under relays_lock.
+ */
+static unsigned long relayTarget = 0;       ///< The state the requests asked for, bit 0 is r1
+static u64 relayLastClose = 0;              ///< CLOCK_MONOTONIC ns of the last close of any relay
+static u64 closeSpacingNs = 0;              ///< The least time between two relay closes
+static u64 minOnNs = 0;                     ///< The least time a relay stays on before it opens
+static u64 minOffNs = 0;                    ///< The least time a relay stays off before it closes
+static unsigned int relayQueueMax = 0;      ///< The most relays that were deferred at once
+static unsigned long relayDeferred = 0;     ///< Requested switches that had to wait
+static struct hrtimer switchTimer;
+
+/**
+ * The switch times and on-times of the relays, written together with relayState under
+ * relaySeq, so the meters can tell the relay state at the time of a pulse from any context.
+ */
+static seqcount_t relaySeq = SEQCNT_ZERO(relaySeq);
+static u64 relayChanged[RELAYS_NUM];        ///< CLOCK_MONOTONIC ns of the last switch of every relay
+static u64 relayOnNs[RELAYS_NUM];           ///< The time every relay was on up to its last open
+
+#define RELAY_HISTORY 16    // Relay switches relays_state_at() can look back over, a power of 2
+
+/** The last switches of the relays, relayHistoryHead counts all of them */
+static struct relay_switch {
+   u64 time;                // CLOCK_MONOTONIC ns of the switch
+   u32 before;              // the state of all relays before it
+} relayHistory[RELAY_HISTORY];
+static unsigned int relayHistoryHead = 0;
+
+/** @brief Write all relays at once, the caller holds relays_lock
+ *  The GPIOs of the relays are written with one gpiod array call, so relays on the same GPIO
+ *  bank change with a single register write on controllers with set_multiple.
+ *  @param now the CLOCK_MONOTONIC time of the switch in ns
+ */
+static void relays_write(unsigned long state, u64 now) {
+   unsigned long old = relayState;
+   DECLARE_BITMAP(values, RELAYS_NUM);
+   unsigned int i;
+
+   values[0] = state;
+   gpiod_set_raw_array_value(RELAYS_NUM, relayDescs, NULL, values);
+   write_seqcount_begin(&relaySeq);
+   if (old != state) {
+      relayHistory[relayHistoryHead & (RELAY_HISTORY - 1)].time   = now;
+      relayHistory[relayHistoryHead & (RELAY_HISTORY - 1)].before = old;
+      relayHistoryHead++;
+   }
+   for (i = 0; i < RELAYS_NUM; i++) {
+      if (!((old ^ state) & BIT(i)))
+         continue;
+      if (old & BIT(i))
+         relayOnNs[i] += now - relayChanged[i];
+      relayChanged[i] = now;
+   }
+   WRITE_ONCE(relayState, state);
+   write_seqcount_end(&relaySeq);
+   shared_relays_update(state);
+
+   for (i = 0; i < RELAYS_NUM; i++) {
+      if (!((old ^ state) & BIT(i)))
+         continue;
+      trace_ebox3_relay(i + 1, !!(old & BIT(i)), !!(state & BIT(i)));
+      events_push(EBOX3_EVENT_RELAY, i + 1, !!(state & BIT(i)), now);
+   }
+   events_wake();
+}
+
+/** @brief Switch the relays that may follow relayTarget now, the caller holds relays_lock
+ *  Opens only wait for the on dwell. Closes also wait for the close spacing and go one at a
+ *  time then, r1 first. If anything is left, switchTimer runs again when it may switch.
+ */
+static void relays_switch(void) {
+   unsigned long pending = relayTarget ^ relayState;
+   unsigned long opens = 0, closes = 0;
+   u64 now = ktime_get_ns();
+   u64 next = U64_MAX;
+   u64 ready;
+   unsigned int i;
+
+   for (i = 0; i < RELAYS_NUM; i++) {
+      if (!(pending & BIT(i)))
+         continue;
+      if (!(relayTarget & BIT(i))) {
+         ready = relayChanged[i] + minOnNs;
+      } else {
+         ready = relayChanged[i] + minOffNs;
+         if (closeSpacingNs)
+            ready = max(ready, (closes ? now : relayLastClose) + closeSpacingNs);
+      }
+      if (ready > now) {
+         next = min(next, ready);
+         continue;
+      }
+      if (relayTarget & BIT(i))
+         closes |= BIT(i);
+      else
+         opens |= BIT(i);
+   }
+
+   if (opens | closes) {
+      relays_write((relayState & ~opens) | closes, now);
+      if (closes)
+         relayLastClose = now;
+   }
+   if (next != U64_MAX)
+      hrtimer_start(&switchTimer, ns_to_ktime(next), HRTIMER_MODE_ABS);
+}
+
+/** @brief The relay state at a past time, any context
+ *  Exact as long as the relays switched at most RELAY_HISTORY times since then, else it is the
+ *  state before the oldest switch that is remembered.
+ *  @param when a CLOCK_MONOTONIC time in ns
+ *  @return returns the relays that were on at that time, bit 0 is r1
+ */
+static u32 relays_state_at(u64 when) {
+   const struct relay_switch *sw;
+   unsigned int seq, head, i;
+   u32 state;
+
+   do {
+      seq = read_seqcount_begin(&relaySeq);
+      state = relayState;
+      head = relayHistoryHead;
+      for (i = 1; i <= RELAY_HISTORY && i <= head; i++) {
+         sw = &relayHistory[(head - i) & (RELAY_HISTORY - 1)];
+         if (sw->time <= when)
+            break;
+         state = sw->before;
+      }
+   } while (read_seqcount_retry(&relaySeq, seq));
+   return state;
+}
+
+/** @brief The total time every relay was on, up to now
+ *  @param onNs receives RELAYS_NUM times in ns
+ *  @param now the CLOCK_MONOTONIC time in ns to count the running on-times to
+ */
+static void relays_read_on(u64 *onNs, u64 now) {
+   unsigned int seq, i;
+
+   do {
+      seq = read_seqcount_begin(&relaySeq);
+      for (i = 0; i < RELAYS_NUM; i++) {
+         onNs[i] = relayOnNs[i];
+         if ((relayState & BIT(i)) && now > relayChanged[i])
+            onNs[i] += now - relayChanged[i];
+      }
+   } while (read_seqcount_retry(&relaySeq, seq));
+}
+
+/** @brief Release the deferred relay switches that are due */
+static enum hrtimer_restart relays_switch_timer(struct hrtimer *timer) {
+   unsigned long flags;
+
+   spin_lock_irqsave(&relays_lock, flags);
+   relays_switch();
+   spin_unlock_irqrestore(&relays_lock, flags);
+   return HRTIMER_NORESTART;
+}
+
+/** @brief Switch a set of relays, any context, never blocks
+ *  The relays the dwell times or the close spacing hold back switch later from switchTimer.
+ *  @param set   the relays to turn on, bit 0 is r1
+ *  @param clear the relays to turn off, set wins if a relay is in both
+ *  @return returns the relay state after the change, without the deferred switches
+ */
+static u32 relays_apply(u32 set, u32 clear) {
+   unsigned long flags, before, after, state;
+   unsigned int depth;
+
+   spin_lock_irqsave(&relays_lock, flags);
+   before = relayTarget ^ relayState;
+   relayTarget = ((relayTarget & ~clear) | set) & RELAYS_ALL;
+   relays_switch();
+   state = relayState;
+   after = relayTarget ^ state;
+
+   relayDeferred += hweight_long(after & ~before & (set | clear));
+   depth = hweight_long(after);
+   if (depth > relayQueueMax)
+      relayQueueMax = depth;
+   spin_unlock_irqrestore(&relays_lock, flags);
+   return state;
+}
 
-static int r1 = 0;
-static int r2 = 0;
-static int r3 = 0;
-static int r4 = 0;
+/** @brief Displays the state of a relay, 1 is on */
+static ssize_t relay_show(char *buf, unsigned int index) {
+   return sprintf(buf, "%d\n", !!(READ_ONCE(relayState) & BIT(index)));
+}
+
+/** @brief Turns a relay on or off, anything but 0 is on */
+static ssize_t relay_store(const char *buf, size_t count, unsigned int index) {
+   int value;
+
+   if (sscanf(buf, "%d", &value) != 1)
+      return -EINVAL;
+   if (value)
+      relays_apply(BIT(index), 0);
+   else
+      relays_apply(0, BIT(index));
+   return count;
+}
 
 /** @brief A callback function to output the relayXstate variable
  *  @param kobj represents a kernel object device that appears in the sysfs filesystem
@@ -19,16 +235,16 @@ static int r4 = 0;
  *  @return return the total number of characters written to the buffer (excluding null)
  */
 static ssize_t r1_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
-   return sprintf(buf, "%d\n", r1);
+   return relay_show(buf, 0);
 }
 static ssize_t r2_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
-   return sprintf(buf, "%d\n", r2);
+   return relay_show(buf, 1);
 }
 static ssize_t r3_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
-   return sprintf(buf, "%d\n", r3);
+   return relay_show(buf, 2);
 }
 static ssize_t r4_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
-   return sprintf(buf, "%d\n", r4);
+   return relay_show(buf, 3);
 }
 
 /** @brief A callback function to read in the relayX variable
@@ -39,23 +255,484 @@ static ssize_t r4_show(struct kobject *kobj, struct kobj_attribute *attr, char *
  *  @return return should return the total number of characters used from the buffer
  */
 static ssize_t r1_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
-   sscanf(buf, "%u", &r1);
-   gpio_set_value(gpioRelay1, r1); 
-   return count;
+   return relay_store(buf, count, 0);
 }
 static ssize_t r2_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
-   sscanf(buf, "%u", &r2);
-   gpio_set_value(gpioRelay2, r2); 
-   return count;
+   return relay_store(buf, count, 1);
 }
 static ssize_t r3_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
-   sscanf(buf, "%u", &r3);
-   gpio_set_value(gpioRelay3, r3); 
-   return count;
+   return relay_store(buf, count, 2);
 }
 static ssize_t r4_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
-   sscanf(buf, "%u", &r4);
-   gpio_set_value(gpioRelay4, r4); 
+   return relay_store(buf, count, 3);
+}
+
+/** @brief Displays the state of all relays as a bitmask, bit 0 is r1 */
+static ssize_t mask_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return sprintf(buf, "0x%lx\n", READ_ONCE(relayState));
+}
+
+/** @brief Switches all relays at once
+ *  "<state>" sets every relay to its bit of state, "<set> <clear>" turns on the relays in set
+ *  and off those in clear and leaves the others alone. Numbers may be given in hex with 0x.
+ */
+static ssize_t mask_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+   unsigned int set, clear;
+
+   switch (sscanf(buf, "%i %i", &set, &clear)) {
+   case 1:
+      clear = RELAYS_ALL & ~set;
+      break;
+   case 2:
+      break;
+   default:
+      return -EINVAL;
+   }
+   if ((set | clear) & ~RELAYS_ALL)
+      return -EINVAL;
+   relays_apply(set, clear);
+   return count;
+}
+
+/** @brief Displays a switching limit in ms */
+static ssize_t limit_show(char *buf, const u64 *limitNs) {
+   unsigned long flags;
+   u64 value;
+
+   spin_lock_irqsave(&relays_lock, flags);
+   value = *limitNs;
+   spin_unlock_irqrestore(&relays_lock, flags);
+   return sprintf(buf, "%llu\n", div_u64(value, NSEC_PER_MSEC));
+}
+
+/** @brief Sets a switching limit in ms, relays a lower limit no longer holds back switch at once */
+static ssize_t limit_store(const char *buf, size_t count, u64 *limitNs) {
+   unsigned long flags;
+   unsigned int value;
+
+   if (sscanf(buf, "%u", &value) != 1)
+      return -EINVAL;
+   spin_lock_irqsave(&relays_lock, flags);
+   *limitNs = (u64)value * NSEC_PER_MSEC;
+   relays_switch();
+   spin_unlock_irqrestore(&relays_lock, flags);
+   return count;
+}
+
+/** @brief The least time between two relay closes in ms, closes wait for each other */
+static ssize_t closeSpacing_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return limit_show(buf, &closeSpacingNs);
+}
+static ssize_t closeSpacing_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+   return limit_store(buf, count, &closeSpacingNs);
+}
+
+/** @brief The least time in ms a relay stays on before it may open again */
+static ssize_t minOn_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return limit_show(buf, &minOnNs);
+}
+static ssize_t minOn_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+   return limit_store(buf, count, &minOnNs);
+}
+
+/** @brief The least time in ms a relay stays off before it may close again */
+static ssize_t minOff_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return limit_show(buf, &minOffNs);
+}
+static ssize_t minOff_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+   return limit_store(buf, count, &minOffNs);
+}
+
+/** @brief Displays the relays that wait for their switch as a bitmask, bit 0 is r1 */
+static ssize_t pending_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return sprintf(buf, "0x%lx\n", READ_ONCE(relayTarget) ^ READ_ONCE(relayState));
+}
+
+/** @brief Displays the number of relays that wait for their switch */
+static ssize_t queueDepth_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return sprintf(buf, "%lu\n", hweight_long(READ_ONCE(relayTarget) ^ READ_ONCE(relayState)));
+}
+
+/** @brief Displays the most relays that waited at once, writing 0 resets it */
+static ssize_t queueMax_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return sprintf(buf, "%u\n", READ_ONCE(relayQueueMax));
+}
+static ssize_t queueMax_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+   unsigned long flags;
+   unsigned int value;
+
+   if (sscanf(buf, "%u", &value) != 1 || value != 0)
+      return -EINVAL;
+   spin_lock_irqsave(&relays_lock, flags);
+   relayQueueMax = hweight_long(relayTarget ^ relayState);
+   spin_unlock_irqrestore(&relays_lock, flags);
+   return count;
+}
+
+/** @brief Displays the number of requested relay switches that were deferred */
+static ssize_t deferred_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   return sprintf(buf, "%lu\n", READ_ONCE(relayDeferred));
+}
+
+#define RELAY_ACTIONS 16    // Timed relay actions that can be pending at once
+
+/**
+ * A relay switch at a CLOCK_MONOTONIC time, run by its own hrtimer. A pulse is an action with
+ * a width, the timer runs again once the relays really switched and undoes it width later.
+ */
+struct relay_action {
+   struct hrtimer timer;
+   unsigned int id;        // 0 while the slot is free
+   u64 when;               // CLOCK_MONOTONIC ns of the next switch
+   u32 set;
+   u32 clear;
+   u64 widthNs;            // 0 if there is nothing to undo
+   bool undo;              // the second half of a pulse, set and clear are swapped
+   u64 started;            // CLOCK_MONOTONIC ns the first half of the pulse was applied
+};
+
+static struct relay_action relayActions[RELAY_ACTIONS];
+static unsigned int relayActionId = 0;      ///< The id of the last queued action
+static DEFINE_SPINLOCK(relay_actions_lock); ///< Protects the slots, taken before relays_lock
+
+/** @brief The time the second half of a pulse is due, the caller holds relays_lock
+ *  The width starts when the relays really switched, the dwell times or the close spacing may
+ *  have held the first half back. While it is still held back, the pulse is checked again
+ *  width after switchTimer runs. Relays that were asked for another state meanwhile are
+ *  undone at once.
+ */
+static u64 relay_pulse_due(const struct relay_action *action, u64 now) {
+   u32 mask = action->set | action->clear;
+   u64 start = action->started;
+   unsigned int i;
+
+   if ((relayState ^ action->clear) & mask) {
+      if ((relayTarget ^ action->clear) & mask)
+         return now;
+      if (hrtimer_is_queued(&switchTimer))
+         now = max(now, (u64)ktime_to_ns(hrtimer_get_expires(&switchTimer)));
+      return now + action->widthNs;
+   }
+   for (i = 0; i < RELAYS_NUM; i++)
+      if (mask & BIT(i))
+         start = max(start, relayChanged[i]);
+   return start + action->widthNs;
+}
+
+/** @brief Switch the relays of a timed action and queue the undo of a pulse */
+static enum hrtimer_restart relay_action_run(struct hrtimer *timer) {
+   struct relay_action *action = container_of(timer, struct relay_action, timer);
+   enum hrtimer_restart restart = HRTIMER_RESTART;
+   unsigned long flags;
+   u64 now = ktime_get_ns(), due = now;
+   u32 set;
+
+   spin_lock_irqsave(&relay_actions_lock, flags);
+   if (action->undo) {
+      spin_lock(&relays_lock);
+      due = relay_pulse_due(action, now);
+      spin_unlock(&relays_lock);
+   }
+   if (due > now) {
+      action->when = due;
+   } else if (action->widthNs && !action->undo) {
+      // the second half turns back what the first half switched, relay_pulse_due() tells when
+      relays_apply(action->set, action->clear);
+      set = action->set;
+      action->set     = action->clear;
+      action->clear   = set;
+      action->undo    = true;
+      action->started = now;
+      action->when    = now + action->widthNs;
+   } else {
+      relays_apply(action->set, action->clear);
+      action->id = 0;
+      restart = HRTIMER_NORESTART;
+   }
+   if (restart == HRTIMER_RESTART)
+      hrtimer_set_expires(timer, ns_to_ktime(action->when));
+   spin_unlock_irqrestore(&relay_actions_lock, flags);
+   return restart;
+}
+
+/** @brief Queue a timed relay action
+ *  @param when    the CLOCK_MONOTONIC time of the switch in ns, a time in the past switches now
+ *  @param set     the relays to turn on
+ *  @param clear   the relays to turn off
+ *  @param widthNs undo the switch this much later, 0 for a lasting switch
+ *  @return returns the id of the action or a negative error
+ */
+static int relay_action_queue(u64 when, u32 set, u32 clear, u64 widthNs) {
+   struct relay_action *action;
+   unsigned long flags;
+   unsigned int i;
+   int id = -EBUSY;
+
+   spin_lock_irqsave(&relay_actions_lock, flags);
+   for (i = 0; i < RELAY_ACTIONS; i++) {
+      action = &relayActions[i];
+      if (action->id)
+         continue;
+      if (++relayActionId > INT_MAX)
+         relayActionId = 1;
+      id = action->id = relayActionId;
+      action->when    = when;
+      action->set     = set;
+      action->clear   = clear;
+      action->widthNs = widthNs;
+      action->undo    = false;
+      hrtimer_start(&action->timer, ns_to_ktime(when), HRTIMER_MODE_ABS);
+      break;
+   }
+   spin_unlock_irqrestore(&relay_actions_lock, flags);
+   return id;
+}
+
+/** @brief Drop a pending action, the relays stay as they are -- also half way through a pulse
+ *  @param id the id of the action, 0 drops all of them
+ *  @return returns 0 if successful, -ENOENT if no such action is pending
+ */
+static int relay_action_cancel(unsigned int id) {
+   struct relay_action *action;
+   unsigned long flags;
+   unsigned int i, cur;
+   int result = -ENOENT;
+
+   for (i = 0; i < RELAY_ACTIONS; i++) {
+      action = &relayActions[i];
+      cur = READ_ONCE(action->id);
+      if (!cur || (id && cur != id))
+         continue;
+      for (;;) {
+         // the timer callback takes relay_actions_lock, wait for it outside of the lock
+         hrtimer_cancel(&action->timer);
+         spin_lock_irqsave(&relay_actions_lock, flags);
+         if (action->id == cur) {
+            action->id = 0;
+            result = 0;
+         } else if (action->id && id) {
+            // the action ran out meanwhile and the slot was queued again, the timer that was
+            // cancelled above belongs to the new action
+            hrtimer_start(&action->timer, ns_to_ktime(action->when), HRTIMER_MODE_ABS);
+         } else if (action->id) {
+            // dropping all of them takes the new action of the slot as well
+            cur = action->id;
+            spin_unlock_irqrestore(&relay_actions_lock, flags);
+            continue;
+         }
+         spin_unlock_irqrestore(&relay_actions_lock, flags);
+         break;
+      }
+   }
+   return id ? result : 0;
+}
+
+/** @brief Displays the pending timed actions, one "id when set clear width" line each
+ *  when is the CLOCK_MONOTONIC time of the next switch in ns and width the undo delay in us.
+ */
+static ssize_t actions_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+   struct relay_action *action;
+   unsigned long flags;
+   ssize_t len = 0;
+   unsigned int i;
+
+   spin_lock_irqsave(&relay_actions_lock, flags);
+   for (i = 0; i < RELAY_ACTIONS; i++) {
+      action = &relayActions[i];
+      if (!action->id)
+         continue;
+      len += scnprintf(buf + len, PAGE_SIZE - len, "%u %llu 0x%x 0x%x %llu\n", action->id, action->when,
+                       action->set, action->clear, div_u64(action->widthNs, NSEC_PER_USEC));
+   }
+   spin_unlock_irqrestore(&relay_actions_lock, flags);
+   return len;
+}
+
+/** @brief Queues or cancels a timed action, times in the CLOCK_MONOTONIC ns of clock_gettime()
+ *  "at <when> <set> <clear> [<width us>]" switches at the time when,
+ *  "in <delay us> <set> <clear> [<width us>]" switches after the delay,
+ *  "pulse <mask> <width us>" turns the relays in mask on now and off after the width,
+ *  "cancel <id>" drops an action and "cancel all" drops every action.
+ */
+static ssize_t actions_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+   char cmd[8];
+   unsigned long long when;
+   unsigned int set, clear, id;
+   unsigned long width = 0;
+   u64 now;
+   int n, result;
+
+   n = sscanf(buf, "%7s %llu %i %i %lu", cmd, &when, &set, &clear, &width);
+   if (n >= 1 && !strcmp(cmd, "cancel")) {
+      if (sscanf(buf, "cancel %u", &id) == 1) {
+         if (id == 0)
+            return -EINVAL;
+      } else if (!strncmp(buf, "cancel all", 10)) {
+         id = 0;
+      } else {
+         return -EINVAL;
+      }
+      result = relay_action_cancel(id);
+      return result ? result : count;
+   }
+   if (n >= 1 && !strcmp(cmd, "pulse")) {
+      if (sscanf(buf, "pulse %i %lu", &set, &width) != 2 || width == 0)
+         return -EINVAL;
+      when  = 0;
+      clear = 0;
+   } else if (n >= 4 && !strcmp(cmd, "at")) {
+      // when is the time of the switch already
+      if (when > KTIME_MAX)
+         return -EINVAL;
+   } else if (n >= 4 && !strcmp(cmd, "in")) {
+      // a delay that does not fit in a ktime would wrap into the past and switch now
+      now = ktime_get_ns();
+      if (when > div_u64(KTIME_MAX - now, NSEC_PER_USEC))
+         return -EINVAL;
+      when = now + when * NSEC_PER_USEC;
+   } else {
+      return -EINVAL;
+   }
+   if ((set | clear) & ~RELAYS_ALL)
+      return -EINVAL;
+
+   result = relay_action_queue(when, set, clear, (u64)width * NSEC_PER_USEC);
+   return result < 0 ? result : count;
+}
+
+/**
+ * The uploaded schedule, kept in the form it is read back in. One CLOCK_REALTIME hrtimer always
+ * points at the next due entry, so the schedule follows the wall clock and needs no user space.
+ */
+#define SCHEDULE_PERIOD_MIN (1 * NSEC_PER_MSEC)   // The shortest repeat of a schedule entry - 1ms
+
+static struct {
+   struct ebox3_schedule head;
+   struct ebox3_schedule_entry entry[EBOX3_SCHEDULE_ENTRIES];
+} schedule;
+static u64 scheduleNext[EBOX3_SCHEDULE_ENTRIES];   ///< CLOCK_REALTIME ns of the next switch, U64_MAX when done
+static struct hrtimer scheduleTimer;
+static DEFINE_SPINLOCK(schedule_lock);     ///< Protects schedule, taken before relays_lock
+static DEFINE_MUTEX(schedule_mutex);       ///< Serializes the uploads
+
+/** @brief The earliest next switch of the schedule, U64_MAX if nothing is left to do */
+static u64 schedule_next(void) {
+   u64 next = U64_MAX;
+   unsigned int i;
+
+   for (i = 0; i < schedule.head.entries; i++)
+      next = min(next, scheduleNext[i]);
+   return next;
+}
+
+/** @brief Switch the relays of all due schedule entries and move on to the next one
+ *  Entries that were due more than once since the last run, e.g. after the wall clock was set
+ *  forward, switch only for their latest time. The due entries are applied in the order of their
+ *  times, the table order breaks ties, and the relays are switched once with the result.
+ */
+static enum hrtimer_restart schedule_run(struct hrtimer *timer) {
+   struct ebox3_schedule_entry *entry;
+   u64 now = ktime_get_real_ns();
+   u64 next;
+   u32 set = 0, clear = 0;
+   unsigned long flags;
+   unsigned int i, due;
+
+   spin_lock_irqsave(&schedule_lock, flags);
+   for (i = 0; i < schedule.head.entries; i++) {
+      entry = &schedule.entry[i];
+      if (entry->period && scheduleNext[i] < now)
+         scheduleNext[i] += div64_u64(now - scheduleNext[i], entry->period) * entry->period;
+   }
+   for (;;) {
+      due = EBOX3_SCHEDULE_ENTRIES;
+      for (i = 0; i < schedule.head.entries; i++)
+         if (scheduleNext[i] <= now && (due == EBOX3_SCHEDULE_ENTRIES || scheduleNext[i] < scheduleNext[due]))
+            due = i;
+      if (due == EBOX3_SCHEDULE_ENTRIES)
+         break;
+
+      // a later entry wins over an earlier one, set wins over clear within an entry
+      entry = &schedule.entry[due];
+      set   = (set & ~entry->clear) | entry->set;
+      clear = (clear & ~entry->set) | entry->clear;
+      if (entry->period && scheduleNext[due] <= KTIME_MAX - entry->period)
+         scheduleNext[due] += entry->period;
+      else
+         scheduleNext[due] = U64_MAX;
+   }
+   next = schedule_next();
+   spin_unlock_irqrestore(&schedule_lock, flags);
+
+   if (set | clear)
+      relays_apply(set, clear);
+   if (next == U64_MAX)
+      return HRTIMER_NORESTART;
+   hrtimer_set_expires(timer, ns_to_ktime(next));
+   return HRTIMER_RESTART;
+}
+
+/** @brief Reads the running schedule as struct ebox3_schedule, start is the resolved start time */
+static ssize_t schedule_read(struct file *filep, struct kobject *kobj, struct bin_attribute *attr,
+                             char *buf, loff_t off, size_t count) {
+   unsigned long flags;
+   size_t len;
+
+   spin_lock_irqsave(&schedule_lock, flags);
+   len = sizeof(schedule.head) + schedule.head.entries * sizeof(schedule.entry[0]);
+   if (off >= len) {
+      count = 0;
+   } else {
+      count = min_t(size_t, count, len - off);
+      memcpy(buf, (char *)&schedule + off, count);
+   }
+   spin_unlock_irqrestore(&schedule_lock, flags);
+   return count;
+}
+
+/** @brief Replaces the schedule with a struct ebox3_schedule, written with a single write()
+ *  The new schedule starts over, the relays stay as they are until its first entry is due.
+ *  A schedule without entries stops the running one.
+ */
+static ssize_t schedule_write(struct file *filep, struct kobject *kobj, struct bin_attribute *attr,
+                              char *buf, loff_t off, size_t count) {
+   const struct ebox3_schedule *table = (const struct ebox3_schedule *)buf;
+   unsigned long flags;
+   unsigned int i;
+   u64 start, next;
+
+   if (off != 0 || count < sizeof(*table))
+      return -EINVAL;
+   if (table->entries > EBOX3_SCHEDULE_ENTRIES ||
+       count != sizeof(*table) + table->entries * sizeof(table->entry[0]))
+      return -EINVAL;
+
+   start = table->start ? table->start : ktime_get_real_ns();
+   if (start > KTIME_MAX)
+      return -EINVAL;
+   for (i = 0; i < table->entries; i++) {
+      if ((table->entry[i].set | table->entry[i].clear) & ~RELAYS_ALL)
+         return -EINVAL;
+      // a shorter period would keep the timer firing back to back
+      if (table->entry[i].period && table->entry[i].period < SCHEDULE_PERIOD_MIN)
+         return -EINVAL;
+      if (table->entry[i].offset > KTIME_MAX - start)
+         return -ERANGE;
+   }
+
+   mutex_lock(&schedule_mutex);
+   hrtimer_cancel(&scheduleTimer);
+   spin_lock_irqsave(&schedule_lock, flags);
+   memcpy(&schedule, table, count);
+   schedule.head.start    = start;
+   schedule.head.reserved = 0;
+   for (i = 0; i < table->entries; i++)
+      scheduleNext[i] = start + table->entry[i].offset;
+   next = schedule_next();
+   spin_unlock_irqrestore(&schedule_lock, flags);
+   if (next != U64_MAX)
+      hrtimer_start(&scheduleTimer, ns_to_ktime(next), HRTIMER_MODE_ABS);
+   mutex_unlock(&schedule_mutex);
    return count;
 }
 
@@ -63,56 +740,88 @@ static struct kobj_attribute r1_attr = __ATTR_RW(r1);
 static struct kobj_attribute r2_attr = __ATTR_RW(r2);
 static struct kobj_attribute r3_attr = __ATTR_RW(r3);
 static struct kobj_attribute r4_attr = __ATTR_RW(r4);
+static struct kobj_attribute relays_mask_attr = __ATTR_RW(mask);
+static struct kobj_attribute relays_actions_attr = __ATTR_RW(actions);
+static struct kobj_attribute relays_closeSpacing_attr = __ATTR(closeSpacing, 0664, closeSpacing_show, closeSpacing_store);
+static struct kobj_attribute relays_minOn_attr = __ATTR(minOn, 0664, minOn_show, minOn_store);
+static struct kobj_attribute relays_minOff_attr = __ATTR(minOff, 0664, minOff_show, minOff_store);
+static struct kobj_attribute relays_pending_attr = __ATTR_RO(pending);
+static struct kobj_attribute relays_queueDepth_attr = __ATTR_RO(queueDepth);
+static struct kobj_attribute relays_queueMax_attr = __ATTR(queueMax, 0664, queueMax_show, queueMax_store);
+static struct kobj_attribute relays_deferred_attr = __ATTR_RO(deferred);
 
 static struct attribute *relays_attrs[] = {
    &r1_attr.attr,
    &r2_attr.attr,
    &r3_attr.attr,
    &r4_attr.attr,
+   &relays_mask_attr.attr,
+   &relays_actions_attr.attr,
+   &relays_closeSpacing_attr.attr,
+   &relays_minOn_attr.attr,
+   &relays_minOff_attr.attr,
+   &relays_pending_attr.attr,
+   &relays_queueDepth_attr.attr,
+   &relays_queueMax_attr.attr,
+   &relays_deferred_attr.attr,
+   NULL,
+};
+
+static struct bin_attribute relays_schedule_attr = __BIN_ATTR_RW(schedule, sizeof(schedule));
+
+static struct bin_attribute *relays_bin_attrs[] = {
+   &relays_schedule_attr,
    NULL,
 };
 
 static struct attribute_group relays_group = {
-   .name  = "relays",
-   .attrs = relays_attrs,
+   .name      = "relays",
+   .attrs     = relays_attrs,
+   .bin_attrs = relays_bin_attrs,
 };
 
 static void relays_init(void) {
-    // Set up the all relays to OFF = 0
+   unsigned int i;
+
+   // Set up the all relays to OFF = 0
    // Causes all gpio to appear in /sys/class/gpio the bool argument prevents the direction from being changed
-   gpio_request(gpioRelay1, "sysfs");
-   gpio_direction_output(gpioRelay1, 0);
-   gpio_export(gpioRelay1, false);
-
-   gpio_request(gpioRelay2, "sysfs");
-   gpio_direction_output(gpioRelay2, 0);
-   gpio_export(gpioRelay2, false);
-
-   gpio_request(gpioRelay3, "sysfs");
-   gpio_direction_output(gpioRelay3, 0);
-   gpio_export(gpioRelay3, false);
-
-   gpio_request(gpioRelay4, "sysfs");
-   gpio_direction_output(gpioRelay4, 0);
-   gpio_export(gpioRelay4, false);
-}
-
-static void relays_exit(void) {
-    // Turn all relays OFF, makes it clear the device was unloaded
-   gpio_set_value(gpioRelay1, 0);
-   gpio_set_value(gpioRelay2, 0);
-   gpio_set_value(gpioRelay3, 0);
-   gpio_set_value(gpioRelay4, 0);
-
-   // Unexport all relays GPIO
-   gpio_unexport(gpioRelay1);
-   gpio_unexport(gpioRelay2);
-   gpio_unexport(gpioRelay3);
-   gpio_unexport(gpioRelay4);
-
-   // Free the relays GPIO
-   gpio_free(gpioRelay1);
-   gpio_free(gpioRelay2);
-   gpio_free(gpioRelay3);
-   gpio_free(gpioRelay4);
-}
\ No newline at end of file
+   for (i = 0; i < RELAYS_NUM; i++) {
+      gpio_request(gpioRelays[i], "sysfs");
+      gpio_direction_output(gpioRelays[i], 0);
+      gpio_export(gpioRelays[i], false);
+      relayDescs[i] = gpio_to_desc(gpioRelays[i]);
+   }
+
+   for (i = 0; i < RELAY_ACTIONS; i++) {
+      hrtimer_init(&relayActions[i].timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+      relayActions[i].timer.function = relay_action_run;
+   }
+   hrtimer_init(&switchTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+   switchTimer.function = relays_switch_timer;
+   hrtimer_init(&scheduleTimer, CLOCK_REALTIME, HRTIMER_MODE_ABS);
+   scheduleTimer.function = schedule_run;
+}
+
+static void relays_exit(struct kobject *parent) {
+   unsigned long flags;
+   unsigned int i;
+
+   // Once the attributes are gone no write can queue an action or a schedule again, and
+   // no timed action or schedule entry may switch a relay from here on
+   sysfs_remove_group(parent, &relays_group);
+   relay_action_cancel(0);
+   hrtimer_cancel(&scheduleTimer);
+
+   // Turn all relays OFF at once, past the switching limits, makes it clear the device was unloaded
+   spin_lock_irqsave(&relays_lock, flags);
+   relayTarget = 0;
+   relays_write(0, ktime_get_ns());
+   spin_unlock_irqrestore(&relays_lock, flags);
+   hrtimer_cancel(&switchTimer);
+
+   // Unexport and free all relays GPIO
+   for (i = 0; i < RELAYS_NUM; i++) {
+      gpio_unexport(gpioRelays[i]);
+      gpio_free(gpioRelays[i]);
+   }
+}
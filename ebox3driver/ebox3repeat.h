@@ -0,0 +1,105 @@
+#include <linux/kernel.h>
+#include <linux/gpio.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+
+#define REPEAT_WIDTH     50000   // The default output pulse width - 50ms, also the least gap between two
+#define REPEAT_WIDTH_MIN 100     // The shortest output pulse width - 100us
+#define REPEAT_WIDTH_MAX 1000000 // The longest output pulse width - 1s
+#define REPEAT_RATIO_MAX 1000    // The largest divide or multiply factor
+#define REPEAT_IDLE      1       // The output idles high, as meter_init() sets it, and pulses low
+
+/**
+ * The pulse repeater of a meter drives multiply output pulses for every divide input pulses
+ * on the meter output. The output pulses are queued and played out by timer, each width long
+ * and followed by a gap as long, so bursts of input pulses are spread out instead of dropped.
+ */
+struct meter_repeat {
+    spinlock_t lock;
+    unsigned int gpio;
+    unsigned int divide;        // 0 turns the repeater off
+    unsigned int multiply;
+    u64 widthNs;
+    unsigned int credit;        // input pulses times multiply not yet repeated, below divide
+    unsigned int pending;       // output pulses waiting for timer
+    bool running;               // timer plays out pulses, it stops once pending is 0
+    bool active;                // the output is in a pulse
+    u64 outPulses;              // output pulses driven
+    struct hrtimer timer;
+};
+
+/** @brief Drive the output pulses, a pulse and the gap after it are one timer run each */
+static enum hrtimer_restart repeat_timer(struct hrtimer *timer) {
+    struct meter_repeat *rep = container_of(timer, struct meter_repeat, timer);
+    enum hrtimer_restart restart = HRTIMER_RESTART;
+    unsigned long flags;
+
+    spin_lock_irqsave(&rep->lock, flags);
+    if (rep->active) {
+        gpio_set_value(rep->gpio, REPEAT_IDLE);
+        rep->active = false;
+        rep->outPulses++;
+    } else if (rep->pending) {
+        gpio_set_value(rep->gpio, !REPEAT_IDLE);
+        rep->active = true;
+        rep->pending--;
+    } else {
+        rep->running = false;
+        restart = HRTIMER_NORESTART;
+    }
+    if (restart == HRTIMER_RESTART)
+        hrtimer_forward_now(timer, ns_to_ktime(rep->widthNs));
+    spin_unlock_irqrestore(&rep->lock, flags);
+    return restart;
+}
+
+/** @brief Queue the output pulses of one input pulse, called by meter_count() */
+static void repeat_pulse(struct meter_repeat *rep) {
+    unsigned long flags;
+
+    if (!READ_ONCE(rep->divide))
+        return;
+
+    spin_lock_irqsave(&rep->lock, flags);
+    if (rep->divide) {
+        rep->credit += rep->multiply;
+        while (rep->credit >= rep->divide) {
+            rep->credit -= rep->divide;
+            if (rep->pending < UINT_MAX)
+                rep->pending++;
+        }
+        if (rep->pending && !rep->running) {
+            rep->running = true;
+            hrtimer_start(&rep->timer, 0, HRTIMER_MODE_REL);
+        }
+    }
+    spin_unlock_irqrestore(&rep->lock, flags);
+}
+
+/** @brief Set the ratio of the repeater, the queued pulses are still played out
+ *  @param divide the input pulses per multiply output pulses, 0 turns the repeater off
+ */
+static void repeat_set_ratio(struct meter_repeat *rep, unsigned int divide, unsigned int multiply) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&rep->lock, flags);
+    rep->divide   = divide;
+    rep->multiply = multiply;
+    rep->credit   = 0;
+    spin_unlock_irqrestore(&rep->lock, flags);
+}
+
+static void repeat_init(struct meter_repeat *rep, unsigned int gpio) {
+    spin_lock_init(&rep->lock);
+    rep->gpio     = gpio;
+    rep->divide   = 0;
+    rep->multiply = 1;
+    rep->widthNs  = REPEAT_WIDTH * NSEC_PER_USEC;
+    hrtimer_init(&rep->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    rep->timer.function = repeat_timer;
+}
+
+/** @brief Stop the repeater, the caller makes sure no more input pulses come in */
+static void repeat_exit(struct meter_repeat *rep) {
+    hrtimer_cancel(&rep->timer);
+}
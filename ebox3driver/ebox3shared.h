@@ -0,0 +1,112 @@
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include "ebox3uapi.h"
+
+#define  SHARED_DEVICE_NAME "ebox3shared"   ///< The device will appear at /dev/ebox3shared
+
+static int    sharedMajor;                  ///< Stores the device number -- determined automatically
+static struct device *sharedDevice = NULL;  ///< The device-driver device struct pointer
+static struct ebox3_shared *shared = NULL;  ///< The page user space maps read-only
+
+/**
+ * Every entry of the page is written under its own sequence counter. A meter entry is written
+ * under the meter lock and the relay entry under relays_lock, so the writers need no lock of
+ * their own.
+ */
+static inline void shared_write_begin(__u32 *seq) {
+    WRITE_ONCE(*seq, *seq + 1);
+    smp_wmb();
+}
+
+static inline void shared_write_end(__u32 *seq) {
+    smp_wmb();
+    WRITE_ONCE(*seq, *seq + 1);
+}
+
+/** @brief Publish the counter and last pulse time of a meter, index 0 is m1 */
+static inline void shared_meter_update(unsigned int index, u64 counter, u64 lastTime) {
+    struct ebox3_shared_meter *m = &shared->meter[index];
+
+    shared_write_begin(&m->seq);
+    m->counter  = counter;
+    m->lastTime = lastTime;
+    shared_write_end(&m->seq);
+}
+
+/** @brief Publish the state of all relays, bit 0 is r1, called under relays_lock only */
+static void shared_relays_update(u32 state) {
+    shared_write_begin(&shared->relay.seq);
+    WRITE_ONCE(shared->relay.state, state);
+    shared_write_end(&shared->relay.seq);
+}
+
+/** @brief Map the shared page, only a read-only mapping of the single page is allowed */
+static int shared_mmap(struct file *filep, struct vm_area_struct *vma) {
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE)
+        return -EINVAL;
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+
+    vma->vm_flags &= ~VM_MAYWRITE;
+    vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+    return remap_pfn_range(vma, vma->vm_start, virt_to_phys(shared) >> PAGE_SHIFT,
+                           vma->vm_end - vma->vm_start, vma->vm_page_prot);
+}
+
+static const struct file_operations shared_fops = {
+    .owner = THIS_MODULE,
+    .mmap  = shared_mmap,
+};
+
+/** @brief Allocate the shared page, must be called before the relays and meters are set up
+ *  @param meters the number of meters
+ *  @param relays the number of relays
+ *  @return returns 0 if successful
+ */
+static int shared_alloc(unsigned int meters, unsigned int relays) {
+    BUILD_BUG_ON(sizeof(struct ebox3_shared) > PAGE_SIZE);
+
+    if (meters > EBOX3_SHARED_METERS)
+        return -EINVAL;
+
+    shared = (struct ebox3_shared *)get_zeroed_page(GFP_KERNEL);
+    if (!shared)
+        return -ENOMEM;
+    shared->version = EBOX3_SHARED_VERSION;
+    shared->meters  = meters;
+    shared->relays  = relays;
+    return 0;
+}
+
+static void shared_free(void) {
+    free_page((unsigned long)shared);
+    shared = NULL;
+}
+
+/** @brief Register /dev/ebox3shared
+ *  @param cls the ebox3 device class
+ *  @return returns 0 if successful
+ */
+static int shared_init(struct class *cls) {
+    sharedMajor = register_chrdev(0, SHARED_DEVICE_NAME, &shared_fops);
+    if (sharedMajor < 0) {
+        printk(KERN_ALERT "Ebox3 Driver: failed to register a major number for %s\n", SHARED_DEVICE_NAME);
+        return sharedMajor;
+    }
+
+    sharedDevice = device_create(cls, NULL, MKDEV(sharedMajor, 0), NULL, SHARED_DEVICE_NAME);
+    if (IS_ERR(sharedDevice)) {
+        unregister_chrdev(sharedMajor, SHARED_DEVICE_NAME);
+        printk(KERN_ALERT "Ebox3 Driver: failed to create the %s device\n", SHARED_DEVICE_NAME);
+        return PTR_ERR(sharedDevice);
+    }
+    return 0;
+}
+
+static void shared_exit(struct class *cls) {
+    device_destroy(cls, MKDEV(sharedMajor, 0));
+    unregister_chrdev(sharedMajor, SHARED_DEVICE_NAME);
+}
@@ -0,0 +1,219 @@
+#include <linux/kernel.h>
+#include <linux/kobject.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#define SHED_RULES       8      // Load shedding rules that can be set at once
+#define SHED_PERIOD_MS   1000   // Rules are checked at least this often, also without pulses
+
+/**
+ * A load shedding rule opens a relay once the rate of a meter stayed at or above trip for hold
+ * and closes it again once the rate is below restore. The rates are in milli-units per hour of
+ * the meter, the unit its rate attribute shows. A relay that several rules shed closes when the
+ * last of them restores.
+ */
+struct shed_rule {
+    unsigned int id;            // 0 while the slot is free
+    unsigned int meter;         // index into meters[], 0 is m1
+    unsigned int relay;         // relay bit, 0 is r1
+    u64 trip;
+    u64 restore;
+    u64 holdNs;
+    u64 overSince;              // CLOCK_MONOTONIC ns the rate went over trip, 0 while it is below
+    bool shed;                  // the rule opened its relay
+    unsigned int trips;
+};
+
+static struct shed_rule shedRules[SHED_RULES];
+static unsigned int shedRuleId = 0;         ///< The id of the last added rule
+static unsigned int shedCount = 0;          ///< Rules in use, 0 keeps the pulse path out of here
+static DEFINE_SPINLOCK(shed_lock);          ///< Protects the rules, taken before relays_lock
+
+static void shed_work(struct work_struct *work);
+static DECLARE_DELAYED_WORK(shedWork, shed_work);
+
+/** @brief Check one rule against the current rate of its meter, the caller holds shed_lock
+ *  @param rate the rate of the meter in milli-units per hour
+ *  @param opens gets the relay bit if the rule trips
+ *  @param closes gets the relay bit if the rule restores
+ */
+static void shed_rule_check(struct shed_rule *rule, u64 rate, u64 now, u32 *opens, u32 *closes) {
+    if (!rule->shed) {
+        if (rate < rule->trip) {
+            rule->overSince = 0;
+            return;
+        }
+        if (!rule->overSince)
+            rule->overSince = now;
+        if (now - rule->overSince >= rule->holdNs) {
+            rule->shed = true;
+            rule->trips++;
+            *opens |= BIT(rule->relay);
+        }
+    } else if (rate < rule->restore) {
+        rule->shed      = false;
+        rule->overSince = 0;
+        *closes |= BIT(rule->relay);
+    }
+}
+
+/** @brief Check the rules of one meter, or of all meters if meter is NULL, and switch their relays
+ *  @param meter the meter that counted pulses, its own counting path or process context only
+ */
+static void shed_check(struct ebox3_meter *meter) {
+    struct ebox3_meter *m;
+    struct shed_rule *rule;
+    struct meter_rate rate;
+    u64 now = ktime_get_ns();
+    u32 opens = 0, closes = 0, held = 0;
+    unsigned long flags;
+    unsigned int i;
+
+    spin_lock_irqsave(&shed_lock, flags);
+    for (i = 0; i < SHED_RULES; i++) {
+        rule = &shedRules[i];
+        if (!rule->id)
+            continue;
+        m = &meters[rule->meter];
+        if (!meter || meter == m) {
+            meter_read_rate(m, &rate);
+            shed_rule_check(rule, div_u64(rate_value(&rate, now, false) * READ_ONCE(m->pulseWeight), 1000),
+                            now, &opens, &closes);
+        }
+        if (rule->shed)
+            held |= BIT(rule->relay);
+    }
+    // a relay stays open as long as any of its rules holds it
+    closes &= ~held;
+    if (opens | closes)
+        relays_apply(closes, opens);
+    spin_unlock_irqrestore(&shed_lock, flags);
+}
+
+/** @brief Check the rules of a meter after its pulses were counted, called by meter_notify() */
+static void shed_meter(struct ebox3_meter *meter) {
+    if (READ_ONCE(shedCount))
+        shed_check(meter);
+}
+
+/** @brief Check all rules, the rates fall and hold times run out also when no pulses come in */
+static void shed_work(struct work_struct *work) {
+    shed_check(NULL);
+    if (READ_ONCE(shedCount))
+        schedule_delayed_work(&shedWork, msecs_to_jiffies(SHED_PERIOD_MS));
+}
+
+/** @brief Displays the rules, one "id mM rR trip hold restore state trips" line each
+ *  trip and restore are in units per hour like the rate of the meter, hold is in seconds and
+ *  state is shed while the rule holds its relay open.
+ */
+static ssize_t rules_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf) {
+    struct shed_rule *rule;
+    unsigned long flags;
+    ssize_t len = 0;
+    unsigned int i;
+
+    spin_lock_irqsave(&shed_lock, flags);
+    for (i = 0; i < SHED_RULES; i++) {
+        rule = &shedRules[i];
+        if (!rule->id)
+            continue;
+        len += scnprintf(buf + len, PAGE_SIZE - len, "%u m%u r%u %llu %llu %llu %s %u\n", rule->id,
+                         meters[rule->meter].id, rule->relay + 1, div_u64(rule->trip, 1000),
+                         div_u64(rule->holdNs, NSEC_PER_SEC), div_u64(rule->restore, 1000),
+                         rule->shed ? "shed" : "armed", rule->trips);
+    }
+    spin_unlock_irqrestore(&shed_lock, flags);
+    return len;
+}
+
+/** @brief Adds or deletes a rule
+ *  "add <meter> <relay> <trip> <hold> <restore>" opens relay rR once the rate of meter mM stayed
+ *  at or above trip units per hour for hold seconds and closes it once the rate is below restore,
+ *  "delete <id>" drops a rule and "delete all" drops every rule. A dropped rule leaves its relay
+ *  as it is.
+ */
+static ssize_t rules_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count) {
+    struct shed_rule *rule = NULL;
+    unsigned int meter, relay, trip, hold, restore, id, i;
+    unsigned long flags;
+    bool all;
+
+    if (sscanf(buf, "add %u %u %u %u %u", &meter, &relay, &trip, &hold, &restore) == 5) {
+        if (meter < 1 || meter > METERS_NUM || relay < 1 || relay > RELAYS_NUM || restore > trip)
+            return -EINVAL;
+
+        spin_lock_irqsave(&shed_lock, flags);
+        for (i = 0; i < SHED_RULES && !rule; i++)
+            if (!shedRules[i].id)
+                rule = &shedRules[i];
+        if (!rule) {
+            spin_unlock_irqrestore(&shed_lock, flags);
+            return -EBUSY;
+        }
+        memset(rule, 0, sizeof(*rule));
+        rule->meter   = meter - 1;
+        rule->relay   = relay - 1;
+        rule->trip    = (u64)trip * 1000;
+        rule->restore = (u64)restore * 1000;
+        rule->holdNs  = (u64)hold * NSEC_PER_SEC;
+        if (++shedRuleId > INT_MAX)
+            shedRuleId = 1;
+        rule->id = shedRuleId;
+        WRITE_ONCE(shedCount, shedCount + 1);
+        spin_unlock_irqrestore(&shed_lock, flags);
+        schedule_delayed_work(&shedWork, msecs_to_jiffies(SHED_PERIOD_MS));
+        return count;
+    }
+
+    all = !strncmp(buf, "delete all", 10);
+    if (!all && (sscanf(buf, "delete %u", &id) != 1 || id == 0))
+        return -EINVAL;
+    spin_lock_irqsave(&shed_lock, flags);
+    for (i = 0; i < SHED_RULES; i++) {
+        if (!shedRules[i].id || (!all && shedRules[i].id != id))
+            continue;
+        shedRules[i].id = 0;
+        WRITE_ONCE(shedCount, shedCount - 1);
+        rule = &shedRules[i];
+    }
+    spin_unlock_irqrestore(&shed_lock, flags);
+    return rule || all ? count : -ENOENT;
+}
+
+static struct kobj_attribute shed_rules_attr = __ATTR_RW(rules);
+
+static struct attribute *shed_attrs[] = {
+    &shed_rules_attr.attr,
+    NULL,
+};
+
+static struct attribute_group shed_group = {
+    .name  = "shed",
+    .attrs = shed_attrs,
+};
+
+/** @brief Add /sys/ebox3/shed, must be called once the relays and meters are set up
+ *  @param parent the /sys/ebox3 kobject
+ *  @return returns 0 if successful
+ */
+static int shed_init(struct kobject *parent) {
+    int result = sysfs_create_group(parent, &shed_group);
+
+    if (result)
+        printk(KERN_ALERT "Ebox3 Driver: failed to create sysfs group for shed\n");
+    return result;
+}
+
+static void shed_exit(struct kobject *parent) {
+    unsigned long flags;
+    unsigned int i;
+
+    sysfs_remove_group(parent, &shed_group);
+    spin_lock_irqsave(&shed_lock, flags);
+    for (i = 0; i < SHED_RULES; i++)
+        shedRules[i].id = 0;
+    WRITE_ONCE(shedCount, 0);
+    spin_unlock_irqrestore(&shed_lock, flags);
+    cancel_delayed_work_sync(&shedWork);
+}
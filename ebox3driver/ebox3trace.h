@@ -0,0 +1,75 @@
+/**
+ * The tracepoints of the ebox3driver LKM, they cost next to nothing while they are off.
+ * Turn them on with e.g.
+ *   echo 1 > /sys/kernel/debug/tracing/events/ebox3/enable
+ * or record them with perf record -e 'ebox3:*'.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ebox3
+
+#if !defined(EBOX3TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define EBOX3TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** A counted meter pulse, timestamp is the CLOCK_MONOTONIC time of its edge and level the
+ *  input level read when the pulse was counted */
+TRACE_EVENT(ebox3_pulse,
+    TP_PROTO(unsigned int meter, u64 timestamp, int level),
+    TP_ARGS(meter, timestamp, level),
+    TP_STRUCT__entry(
+        __field(unsigned int, meter)
+        __field(u64, timestamp)
+        __field(int, level)
+    ),
+    TP_fast_assign(
+        __entry->meter     = meter;
+        __entry->timestamp = timestamp;
+        __entry->level     = level;
+    ),
+    TP_printk("m%u timestamp=%llu level=%d", __entry->meter, __entry->timestamp, __entry->level)
+);
+
+/** An edge of a meter input taken by the IRQ thread, accepted is 1 if it was counted and 0 for
+ *  a bounce, an edge that waits for its level check or the replay of an edge sampled already */
+TRACE_EVENT(ebox3_edge,
+    TP_PROTO(unsigned int meter, u64 timestamp, bool accepted),
+    TP_ARGS(meter, timestamp, accepted),
+    TP_STRUCT__entry(
+        __field(unsigned int, meter)
+        __field(u64, timestamp)
+        __field(bool, accepted)
+    ),
+    TP_fast_assign(
+        __entry->meter     = meter;
+        __entry->timestamp = timestamp;
+        __entry->accepted  = accepted;
+    ),
+    TP_printk("m%u timestamp=%llu accepted=%d", __entry->meter, __entry->timestamp, __entry->accepted)
+);
+
+/** A relay that switched, from any context -- sysfs, ioctl, timed actions or load shedding */
+TRACE_EVENT(ebox3_relay,
+    TP_PROTO(unsigned int relay, int old, int new),
+    TP_ARGS(relay, old, new),
+    TP_STRUCT__entry(
+        __field(unsigned int, relay)
+        __field(int, old)
+        __field(int, new)
+    ),
+    TP_fast_assign(
+        __entry->relay = relay;
+        __entry->old   = old;
+        __entry->new   = new;
+    ),
+    TP_printk("r%u %d -> %d", __entry->relay, __entry->old, __entry->new)
+);
+
+#endif
+
+// the header is read again by define_trace.h from this directory, the Makefile adds it to the include path
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ebox3trace
+#include <trace/define_trace.h>
@@ -0,0 +1,197 @@
+/**
+ * @file   ebox3uapi.h
+ * @brief  Definitions shared between the ebox3driver LKM and user space programs.
+ * Everything in here is part of the binary interface -- only append, never reorder.
+*/
+#ifndef EBOX3UAPI_H
+#define EBOX3UAPI_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/**
+ * One pulse as returned by read() on /dev/ebox3pulses. A read returns as many whole
+ * records as fit in the buffer and are available.
+ */
+struct ebox3_pulse_record {
+    __u64 timestamp;    ///< CLOCK_MONOTONIC time of the pulse in nanoseconds
+    __u32 meter;        ///< Meter number, 1 for m1
+    __u32 dropped;      ///< Pulses of this meter lost to a full ring since its previous record
+} __attribute__((packed));
+
+/**
+ * The read-only page that /dev/ebox3shared maps. Every entry has its own sequence counter
+ * which is odd while the driver updates the entry, see ebox3_shared_read_meter() for the
+ * way to take a consistent copy of an entry.
+ */
+#define EBOX3_SHARED_VERSION    1
+#define EBOX3_SHARED_METERS     32      ///< Room for meters in the page, meters says how many are used
+
+struct ebox3_shared_meter {
+    __u32 seq;          ///< Odd while the entry is being updated
+    __u32 reserved0;
+    __u64 counter;      ///< Number of pulses, same value as /sys/ebox3/meters/mN/counter
+    __u64 lastTime;     ///< CLOCK_REALTIME time of the last pulse in nanoseconds
+    __u64 reserved[5];  ///< Pads the entry to its own 64 byte cache line
+};
+
+struct ebox3_shared_relays {
+    __u32 seq;          ///< Odd while the entry is being updated
+    __u32 state;        ///< Bit 0 is r1, set when the relay is on
+    __u64 reserved[7];
+};
+
+struct ebox3_shared {
+    __u32 version;      ///< EBOX3_SHARED_VERSION
+    __u32 meters;       ///< Number of used entries in meter[]
+    __u32 relays;       ///< Number of used bits in relay.state
+    __u32 reserved[13];
+    struct ebox3_shared_relays relay;
+    struct ebox3_shared_meter meter[EBOX3_SHARED_METERS];
+};
+
+/**
+ * The binary form of /sys/ebox3/meters/snapshot_bin. All counters and last pulse times were
+ * current at the same instant, captureTime.
+ */
+struct ebox3_snapshot_meter {
+    __u64 counter;      ///< Number of pulses
+    __u64 lastTime;     ///< CLOCK_REALTIME time of the last pulse in nanoseconds
+};
+
+struct ebox3_snapshot {
+    __u64 captureTime;  ///< CLOCK_REALTIME time of the snapshot in nanoseconds
+    __u32 meters;       ///< Number of entries in meter[]
+    __u32 reserved;
+    struct ebox3_snapshot_meter meter[];
+};
+
+/**
+ * The binary form of /sys/ebox3/relays/schedule. An entry switches the relays at start plus
+ * offset and again every period after that if period is not 0. Entries due at the same time
+ * are applied in table order, a later entry wins over an earlier one.
+ */
+#define EBOX3_SCHEDULE_ENTRIES  64      ///< The most entries a schedule can have
+
+struct ebox3_schedule_entry {
+    __u64 offset;       ///< ns from the start of the schedule to the first switch
+    __u64 period;       ///< ns between the repeats, at least 1 ms, 0 to switch only once
+    __u32 set;          ///< Relays to turn on, bit 0 is r1
+    __u32 clear;        ///< Relays to turn off, set wins over clear
+};
+
+struct ebox3_schedule {
+    __u64 start;        ///< CLOCK_REALTIME time in ns the offsets count from, 0 for the time of the upload
+    __u32 entries;      ///< Number of entries in entry[], 0 stops the schedule
+    __u32 reserved;
+    struct ebox3_schedule_entry entry[];
+};
+
+/**
+ * The ioctls of /dev/ebox3ctl.
+ */
+#define EBOX3_IOC_MAGIC     'E'
+
+/** EBOX3_IOC_RELAYS: turn on the relays in set and off those in clear, set wins over clear */
+struct ebox3_relay_mask {
+    __u32 set;          ///< Relays to turn on, bit 0 is r1
+    __u32 clear;        ///< Relays to turn off
+    __u32 state;        ///< Returns the state of all relays after the change, without deferred switches
+    __u32 reserved;
+};
+
+#define EBOX3_IOC_RELAYS    _IOWR(EBOX3_IOC_MAGIC, 1, struct ebox3_relay_mask)
+
+/** EBOX3_IOC_GPIO: read the levels of all lines of the driver at once, also /sys/ebox3/gpio/snapshot */
+struct ebox3_gpio_snapshot {
+    __u64 timestamp;    ///< CLOCK_MONOTONIC time of the read in nanoseconds
+    __u32 inputs;       ///< Meter input levels, bit 0 is m1
+    __u32 outputs;      ///< Meter output levels, bit 0 is m1
+    __u32 relays;       ///< Relay output levels, bit 0 is r1
+    __u32 reserved;
+};
+
+#define EBOX3_IOC_GPIO      _IOR(EBOX3_IOC_MAGIC, 2, struct ebox3_gpio_snapshot)
+
+/**
+ * EBOX3_IOC_BATCH: one control loop iteration in a single call. The meters in meters are read
+ * at one instant and the counters of the meters in reset restart from 0 in the same step, then
+ * the relays are switched. A pulse is either in the values read or counted after the reset.
+ */
+struct ebox3_batch {
+    __u32 meters;       ///< Meters to read, bit 0 is m1
+    __u32 reset;        ///< Meters to reset along with the read, must be read too
+    __u32 set;          ///< Relays to turn on, bit 0 is r1
+    __u32 clear;        ///< Relays to turn off, set wins over clear
+    __u32 relays;       ///< Returns the state of all relays after the switch
+    __u32 reserved;
+    __u64 captureTime;  ///< Returns the CLOCK_REALTIME time of the read in nanoseconds
+    struct ebox3_snapshot_meter meter[EBOX3_SHARED_METERS];    ///< Returns the meters read, m1 first
+};
+
+#define EBOX3_IOC_BATCH     _IOWR(EBOX3_IOC_MAGIC, 5, struct ebox3_batch)
+
+/**
+ * One event as returned by read() on /dev/ebox3events. Every open file reads all events from
+ * the time of its open() on, filtered by its EBOX3_IOC_EVENTS_MASK.
+ */
+#define EBOX3_EVENT_PULSE   1   ///< A meter counted a pulse, value is the low 32 bits of its counter
+#define EBOX3_EVENT_EDGE    2   ///< An edge on a meter input raised an IRQ, value is 1 if it was counted right away
+#define EBOX3_EVENT_RELAY   3   ///< A relay switched, value is 1 if it is on now
+#define EBOX3_EVENTS_ALL    ((1 << EBOX3_EVENT_PULSE) | (1 << EBOX3_EVENT_EDGE) | (1 << EBOX3_EVENT_RELAY))
+
+struct ebox3_event {
+    __u64 timestamp;    ///< CLOCK_MONOTONIC time of the event in nanoseconds
+    __u16 type;         ///< EBOX3_EVENT_*
+    __u16 source;       ///< Meter or relay number, 1 for m1 or r1
+    __u32 value;
+};
+
+/** EBOX3_IOC_EVENTS_MASK: read only the events whose 1 << type is set in the mask */
+#define EBOX3_IOC_EVENTS_MASK       _IOW(EBOX3_IOC_MAGIC, 3, __u32)
+/** EBOX3_IOC_EVENTS_OVERRUNS: the number of events this file lost because it fell behind */
+#define EBOX3_IOC_EVENTS_OVERRUNS   _IOR(EBOX3_IOC_MAGIC, 4, __u64)
+
+/**
+ * EBOX3_IOC_NOTIFY: signal an eventfd on the pulses of a meter. The eventfd is signalled once
+ * at least every pulses came in since the last signal and at least intervalMs passed since then,
+ * reading it returns the pulses counted since the last read. A file of /dev/ebox3ctl has one
+ * eventfd per meter, registering again replaces it, fd -1 drops it and close() drops them all.
+ */
+struct ebox3_notify {
+    __s32 fd;           ///< The eventfd, -1 to drop the one registered
+    __u32 meter;        ///< Meter number, 1 for m1
+    __u32 every;        ///< Pulses per signal, 0 or 1 signals on every pulse
+    __u32 intervalMs;   ///< Least time between two signals in milliseconds, 0 for no limit
+};
+
+#define EBOX3_IOC_NOTIFY    _IOW(EBOX3_IOC_MAGIC, 6, struct ebox3_notify)
+
+#ifndef __KERNEL__
+/** @brief Take a consistent copy of one meter entry of the mapped page
+ *  @param shared the page mapped from /dev/ebox3shared
+ *  @param i the meter index, 0 for m1
+ *  @param counter receives the pulse counter
+ *  @param lastTime receives the time of the last pulse
+ */
+static inline void ebox3_shared_read_meter(const struct ebox3_shared *shared, unsigned int i,
+                                           __u64 *counter, __u64 *lastTime) {
+    const struct ebox3_shared_meter *m = &shared->meter[i];
+    __u32 seq;
+
+    do {
+        while ((seq = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        *counter  = m->counter;
+        *lastTime = m->lastTime;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&m->seq, __ATOMIC_RELAXED) != seq);
+}
+
+/** @brief Read the relay bitmask of the mapped page, bit 0 is r1 */
+static inline __u32 ebox3_shared_read_relays(const struct ebox3_shared *shared) {
+    return __atomic_load_n(&shared->relay.state, __ATOMIC_ACQUIRE);
+}
+#endif
+
+#endif
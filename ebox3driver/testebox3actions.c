@@ -0,0 +1,95 @@
+/**
+ * @file   testebox3actions.c
+ * @author Yuriy Kozhynov
+ * @brief  A Linux user space program that checks the relay pulses of the ebox3driver.c LKM.
+ * It queues "pulse <mask> <width>" at /sys/ebox3/relays/actions and takes the times the relays
+ * switched on and off again from /dev/ebox3events. Every relay has to stay on for at least the
+ * width and not much longer, also if minOff or closeSpacing hold the switch on back. The relays
+ * in mask have to be off before the test and minOn below the width.
+ * Usage: testebox3actions [<mask> [<width us>]], e.g. testebox3actions 0x1 100000
+*/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include "ebox3uapi.h"
+
+#define ACTIONS_PATH "/sys/ebox3/relays/actions"
+#define RELAYS_MAX   32
+#define SLACK_US     20000          ///< How much longer than the width a relay may stay on
+
+int main(int argc, char *argv[]){
+   unsigned long long on[RELAYS_MAX] = { 0 }, width, held;
+   unsigned int mask = 0x1, left, r;
+   __u32 types = 1 << EBOX3_EVENT_RELAY;
+   struct ebox3_event event;
+   struct pollfd pfd;
+   char cmd[64];
+   int fd, failed = 0;
+
+   if (argc > 1)
+      mask = strtoul(argv[1], NULL, 0);
+   width = argc > 2 ? strtoull(argv[2], NULL, 0) : 100000;
+   if (mask == 0 || width == 0){
+      printf("Usage: %s [<mask> [<width us>]]\n", argv[0]);
+      return EINVAL;
+   }
+
+   pfd.fd = open("/dev/ebox3events", O_RDONLY);
+   if (pfd.fd < 0){
+      perror("Failed to open the events device...");
+      return errno;
+   }
+   if (ioctl(pfd.fd, EBOX3_IOC_EVENTS_MASK, &types) < 0){
+      perror("Failed to set the event mask.");
+      return errno;
+   }
+   pfd.events = POLLIN;
+
+   fd = open(ACTIONS_PATH, O_WRONLY);
+   if (fd < 0){
+      perror("Failed to open the relay actions...");
+      return errno;
+   }
+   snprintf(cmd, sizeof(cmd), "pulse 0x%x %llu", mask, width);
+   if (write(fd, cmd, strlen(cmd)) < 0){
+      perror("Failed to queue the pulse.");
+      return errno;
+   }
+   close(fd);
+
+   // every relay of the mask switches on and off once, give up a second after the width
+   left = __builtin_popcount(mask) * 2;
+   while (left){
+      if (poll(&pfd, 1, width / 1000 + 1000) <= 0){
+         printf("FAIL: the relays did not switch back in time\n");
+         return ETIMEDOUT;
+      }
+      if (read(pfd.fd, &event, sizeof(event)) != sizeof(event)){
+         perror("Failed to read an event.");
+         return errno;
+      }
+      r = event.source - 1;
+      if (r >= RELAYS_MAX || !(mask & (1U << r)))
+         continue;
+      left--;
+      if (event.value){
+         on[r] = event.timestamp;
+         continue;
+      }
+      held = (event.timestamp - on[r]) / 1000;
+      printf("r%u on for %llu us\n", r + 1, held);
+      if (!on[r] || held < width || held > width + SLACK_US){
+         printf("FAIL: r%u should be on for %llu us\n", r + 1, width);
+         failed = 1;
+      }
+   }
+   close(pfd.fd);
+   if (!failed)
+      printf("PASS\n");
+   return failed;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file   testebox3ctl.c
+ * @author Yuriy Kozhynov
+ * @brief  A Linux user space program that switches the relays of the ebox3driver.c LKM
+ * with one EBOX3_IOC_RELAYS ioctl on /dev/ebox3ctl, or reads the levels of all its lines.
+ * Usage: testebox3ctl <set> <clear>, e.g. testebox3ctl 0x5 0xa turns r1 and r3 on, r2 and r4 off
+ *        testebox3ctl gpio, prints the EBOX3_IOC_GPIO snapshot of all lines
+ *        testebox3ctl batch <meters> <reset> <set> <clear>, one EBOX3_IOC_BATCH control loop
+ *        iteration, e.g. testebox3ctl batch 0x3f 0x1 0x2 0 reads all meters, resets m1, turns r2 on
+ *        testebox3ctl notify <meter> <every> <intervalMs>, waits on an EBOX3_IOC_NOTIFY eventfd,
+ *        e.g. testebox3ctl notify 1 100 1000 wakes up for every 100 pulses of m1, at most once a second
+*/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include<sys/eventfd.h>
+#include "ebox3uapi.h"
+
+int main(int argc, char *argv[]){
+   struct ebox3_relay_mask mask = { 0 };
+   struct ebox3_gpio_snapshot snap;
+   struct ebox3_batch batch = { 0 };
+   struct ebox3_notify notify;
+   unsigned long long pulses;
+   unsigned int i;
+   int fd;
+
+   if (argc != 3 && (argc != 2 || strcmp(argv[1], "gpio")) && (argc != 6 || strcmp(argv[1], "batch")) &&
+       (argc != 5 || strcmp(argv[1], "notify"))){
+      printf("Usage: %s <set> <clear> | gpio | batch <meters> <reset> <set> <clear> | notify <meter> <every> <intervalMs>\n", argv[0]);
+      return EINVAL;
+   }
+
+   fd = open("/dev/ebox3ctl", O_RDWR);             // Open the device with read/write access
+   if (fd < 0){
+      perror("Failed to open the device...");
+      return errno;
+   }
+   if (argc == 2){
+      if (ioctl(fd, EBOX3_IOC_GPIO, &snap) < 0){
+         perror("Failed to read the lines.");
+         return errno;
+      }
+      printf("At %llu ns: inputs 0x%x outputs 0x%x relays 0x%x\n", (unsigned long long)snap.timestamp,
+             snap.inputs, snap.outputs, snap.relays);
+      close(fd);
+      return 0;
+   }
+   if (argc == 6){
+      batch.meters = strtoul(argv[2], NULL, 0);
+      batch.reset  = strtoul(argv[3], NULL, 0);
+      batch.set    = strtoul(argv[4], NULL, 0);
+      batch.clear  = strtoul(argv[5], NULL, 0);
+      if (ioctl(fd, EBOX3_IOC_BATCH, &batch) < 0){
+         perror("Failed to run the batch.");
+         return errno;
+      }
+      printf("At %llu ns, relays now 0x%x\n", (unsigned long long)batch.captureTime, batch.relays);
+      for (i = 0; i < EBOX3_SHARED_METERS; i++)
+         if (batch.meters & (1u << i))
+            printf("m%u %llu %llu\n", i + 1, (unsigned long long)batch.meter[i].counter,
+                   (unsigned long long)batch.meter[i].lastTime);
+      close(fd);
+      return 0;
+   }
+
+   if (argc == 5){
+      notify.fd         = eventfd(0, 0);
+      notify.meter      = strtoul(argv[2], NULL, 0);
+      notify.every      = strtoul(argv[3], NULL, 0);
+      notify.intervalMs = strtoul(argv[4], NULL, 0);
+      if (notify.fd < 0 || ioctl(fd, EBOX3_IOC_NOTIFY, &notify) < 0){
+         perror("Failed to register the eventfd.");
+         return errno;
+      }
+      printf("Waiting for the pulses of m%u, Ctrl-C to stop...\n", notify.meter);
+      for (;;) {                                    // The eventfd stays registered until fd is closed
+         if (read(notify.fd, &pulses, sizeof(pulses)) != sizeof(pulses)){
+            perror("Failed to read the eventfd.");
+            return errno;
+         }
+         printf("%llu pulses\n", pulses);
+      }
+   }
+
+   mask.set   = strtoul(argv[1], NULL, 0);
+   mask.clear = strtoul(argv[2], NULL, 0);
+   if (ioctl(fd, EBOX3_IOC_RELAYS, &mask) < 0){
+      perror("Failed to switch the relays.");
+      return errno;
+   }
+   printf("The relays are now 0x%x\n", mask.state);
+   close(fd);
+   return 0;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file   testebox3events.c
+ * @author Yuriy Kozhynov
+ * @brief  A Linux user space program that reads the events of the ebox3driver.c LKM from
+ * /dev/ebox3events with poll() and prints them. Several copies can run at the same time, each
+ * of them gets every event.
+ * Usage: testebox3events [<mask>], e.g. testebox3events 0x8 prints the relay switches only
+*/
+#include<stdio.h>
+#include<stdlib.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<poll.h>
+#include<unistd.h>
+#include<sys/ioctl.h>
+#include "ebox3uapi.h"
+
+#define EVENTS_LENGTH 1024                          ///< Events read with one read() call
+static struct ebox3_event events[EVENTS_LENGTH];
+
+int main(int argc, char *argv[]){
+   static const char *types[] = { "?", "pulse", "edge", "relay" };
+   struct pollfd pfd;
+   __u32 mask = EBOX3_EVENTS_ALL;
+   __u64 overruns, seen = 0;
+   ssize_t ret;
+   int i, n;
+
+   if (argc > 1)
+      mask = strtoul(argv[1], NULL, 0);
+
+   pfd.fd = open("/dev/ebox3events", O_RDONLY | O_NONBLOCK);
+   if (pfd.fd < 0){
+      perror("Failed to open the device...");
+      return errno;
+   }
+   if (ioctl(pfd.fd, EBOX3_IOC_EVENTS_MASK, &mask) < 0){
+      perror("Failed to set the event mask.");
+      return errno;
+   }
+   pfd.events = POLLIN;
+   printf("Reading events from /dev/ebox3events, Ctrl-C to stop...\n");
+   for (;;) {
+      if (poll(&pfd, 1, -1) < 0){
+         perror("Failed to poll the device.");
+         return errno;
+      }
+      ret = read(pfd.fd, events, sizeof(events));
+      if (ret < 0){
+         if (errno == EAGAIN)                       // Only events of other types were pending
+            continue;
+         perror("Failed to read the events from the device.");
+         return errno;
+      }
+      n = ret / sizeof(events[0]);
+      for (i = 0; i < n; i++) {
+         printf("%llu.%09llu %s %u %u\n",
+                (unsigned long long)events[i].timestamp / 1000000000ULL,
+                (unsigned long long)events[i].timestamp % 1000000000ULL,
+                types[events[i].type < 4 ? events[i].type : 0], events[i].source, events[i].value);
+      }
+      if (ioctl(pfd.fd, EBOX3_IOC_EVENTS_OVERRUNS, &overruns) == 0 && overruns != seen){
+         printf("%llu events lost\n", (unsigned long long)(overruns - seen));
+         seen = overruns;
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file   testebox3pulses.c
+ * @author Yuriy Kozhynov
+ * @brief  A Linux user space program that reads the pulse records of the ebox3driver.c LKM
+ * from /dev/ebox3pulses and prints them.
+*/
+#include<stdio.h>
+#include<stdlib.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include "ebox3uapi.h"
+
+#define RECORDS_LENGTH 4096                         ///< Records read with one read() call
+static struct ebox3_pulse_record records[RECORDS_LENGTH];
+
+int main(){
+   int fd, i, n;
+   ssize_t ret;
+   printf("Reading pulses from /dev/ebox3pulses, Ctrl-C to stop...\n");
+   fd = open("/dev/ebox3pulses", O_RDONLY);        // Open the device with read only access
+   if (fd < 0){
+      perror("Failed to open the device...");
+      return errno;
+   }
+   for (;;) {
+      ret = read(fd, records, sizeof(records));   // Blocks until at least one pulse is available
+      if (ret < 0){
+         perror("Failed to read the pulses from the device.");
+         return errno;
+      }
+      n = ret / sizeof(records[0]);
+      for (i = 0; i < n; i++) {
+         printf("m%u %llu.%09llu", records[i].meter,
+                (unsigned long long)records[i].timestamp / 1000000000ULL,
+                (unsigned long long)records[i].timestamp % 1000000000ULL);
+         if (records[i].dropped)
+            printf(" (%u dropped before)", records[i].dropped);
+         printf("\n");
+      }
+   }
+   return 0;
+}
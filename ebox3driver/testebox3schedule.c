@@ -0,0 +1,80 @@
+/**
+ * @file   testebox3schedule.c
+ * @author Yuriy Kozhynov
+ * @brief  A Linux user space program that uploads a relay schedule to the ebox3driver.c LKM
+ * through /sys/ebox3/relays/schedule and prints the schedule that is running.
+ * Usage: testebox3schedule <start> [<offset>:<set>:<clear>[:<period>] ...]
+ * start is a unix time in seconds or "now", offset and period are in seconds, e.g.
+ * testebox3schedule 1700000000 25200:0x1:0:86400 79200:0:0x1:86400 turns r1 on at 7:00 and
+ * off at 22:00 every day if 1700000000 is a midnight. Without entries the schedule stops.
+*/
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include "ebox3uapi.h"
+
+#define SCHEDULE_PATH "/sys/ebox3/relays/schedule"
+#define NS_PER_SEC    1000000000ULL
+
+static struct {
+   struct ebox3_schedule head;
+   struct ebox3_schedule_entry entry[EBOX3_SCHEDULE_ENTRIES];
+} schedule;
+
+int main(int argc, char *argv[]){
+   struct ebox3_schedule_entry *e;
+   unsigned long long offset, period;
+   unsigned int set, clear, i;
+   size_t len;
+   ssize_t ret;
+   int fd, n;
+
+   if (argc < 2 || argc - 2 > EBOX3_SCHEDULE_ENTRIES){
+      printf("Usage: %s <start> [<offset>:<set>:<clear>[:<period>] ...]\n", argv[0]);
+      return EINVAL;
+   }
+   schedule.head.start = strcmp(argv[1], "now") ? strtoull(argv[1], NULL, 0) * NS_PER_SEC : 0;
+   for (i = 0; i < (unsigned int)argc - 2; i++){
+      period = 0;
+      n = sscanf(argv[i + 2], "%llu:%i:%i:%llu", &offset, &set, &clear, &period);
+      if (n < 3){
+         printf("Bad entry %s\n", argv[i + 2]);
+         return EINVAL;
+      }
+      e = &schedule.entry[i];
+      e->offset = offset * NS_PER_SEC;
+      e->period = period * NS_PER_SEC;
+      e->set    = set;
+      e->clear  = clear;
+   }
+   schedule.head.entries = argc - 2;
+
+   fd = open(SCHEDULE_PATH, O_RDWR);
+   if (fd < 0){
+      perror("Failed to open the schedule...");
+      return errno;
+   }
+   len = sizeof(schedule.head) + schedule.head.entries * sizeof(schedule.entry[0]);
+   if (write(fd, &schedule, len) != (ssize_t)len){     // The whole table has to go in one write
+      perror("Failed to upload the schedule.");
+      return errno;
+   }
+
+   memset(&schedule, 0, sizeof(schedule));
+   ret = pread(fd, &schedule, sizeof(schedule), 0);
+   if (ret < (ssize_t)sizeof(schedule.head)){
+      perror("Failed to read the schedule back.");
+      return errno;
+   }
+   printf("Start %llu ns, %u entries\n", (unsigned long long)schedule.head.start, schedule.head.entries);
+   for (i = 0; i < schedule.head.entries; i++){
+      e = &schedule.entry[i];
+      printf("  +%llu s set 0x%x clear 0x%x every %llu s\n", (unsigned long long)(e->offset / NS_PER_SEC),
+             e->set, e->clear, (unsigned long long)(e->period / NS_PER_SEC));
+   }
+   close(fd);
+   return 0;
+}
@@ -15,7 +15,13 @@
 #include <linux/interrupt.h>  // Required for the IRQ code
 #include <linux/kobject.h>    // Using kobjects for the sysfs bindings
 #include <linux/time.h>       // Using the clock to measure time between button presses
-#define  DEBOUNCE_TIME 50     // The default bounce time -- 50ms
+#include <linux/ktime.h>      // Using the monotonic clock for the software debounce
+#include <linux/debugfs.h>    // The IRQ histograms at /sys/kernel/debug/ebox3inputs
+#include "../ebox3driver/ebox3irqstats.h"  // The IRQ histograms, shared with ebox3driver
+#define  CREATE_TRACE_POINTS
+#include "ebox3inputs_trace.h"  // The ebox3inputs:ebox3inputs_edge tracepoint
+#define  DEBOUNCE_TIME 50     // The default bounce time -- 50us, gpio_set_debounce() takes microseconds
+#define  CAPTURE_SIZE  64     // Edges queued from the hard IRQ for the IRQ thread, a power of 2
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Yuriy Kozhynov");
@@ -31,9 +37,17 @@ static char   gpioName[7] = "meter0";      ///< Null terminated default string -
 static int    irqNumber;                    ///< Used to share the IRQ number within this file
 static int    numberOfPulses = 0;            ///< For information, store the number of button presses
 static struct timespec ts_last, ts_current, ts_diff;  ///< timespecs from linux/time.h (has nano precision)
+static bool   swDebounce = false;           ///< The GPIO controller has no debounce, filter the edges in the handler
+static u64    lastEdge;                     ///< CLOCK_MONOTONIC ns of the last accepted edge
+static u64    capture[CAPTURE_SIZE];        ///< CLOCK_MONOTONIC ns of the edges the IRQ thread has not seen yet
+static unsigned int captureHead, captureTail; ///< Written by the hard IRQ and the IRQ thread only
 
-/// Function prototype for the custom IRQ handler function -- see below for the implementation
+static struct irq_stats irqStats;            ///< Filled in while /sys/kernel/debug/ebox3inputs/irqstats is on
+static struct dentry *debugDir;
+
+/// Function prototypes for the custom IRQ handler functions -- see below for the implementation
 static irq_handler_t ebox3gpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs);
+static irq_handler_t ebox3gpio_irq_thread(unsigned int irq, void *dev_id, struct pt_regs *regs);
 
 /** @brief A callback function to output the numberOfPulses variable
  *  @param kobj represents a kernel object device that appears in the sysfs filesystem
@@ -104,6 +118,33 @@ static struct attribute_group attr_group = {
 
 static struct kobject *ebox3_kobj;
 
+/** @brief Displays the IRQ histograms, times in nanoseconds */
+static int irq_show(struct seq_file *s, void *unused) {
+   irq_hist_show(s, "hardirq", &irqStats.hardCost);
+   irq_hist_show(s, "wakeup", &irqStats.wakeup);
+   irq_hist_show(s, "thread", &irqStats.threadCost);
+   return 0;
+}
+
+static int irq_open(struct inode *inode, struct file *filep) {
+   return single_open(filep, irq_show, NULL);
+}
+
+/** @brief Any write clears the IRQ histograms */
+static ssize_t irq_write(struct file *filep, const char __user *buffer, size_t len, loff_t *offset) {
+   irq_stats_reset(&irqStats);
+   return len;
+}
+
+static const struct file_operations irq_fops = {
+   .owner   = THIS_MODULE,
+   .open    = irq_open,
+   .read    = seq_read,
+   .write   = irq_write,
+   .llseek  = seq_lseek,
+   .release = single_release,
+};
+
 /** @brief The LKM initialization function
  *  The static keyword restricts the visibility of the function to within this C file. The __init
  *  macro means that for a built-in driver (not a LKM) the function is only used at initialization
@@ -141,8 +182,11 @@ static int __init ebox3Inputs_init(void) {
                                                 // the bool argument prevents the direction from being changed
    gpio_request(gpioMeterIn_1, "sysfs");            // Set up the gpioInput0
    gpio_direction_input(gpioMeterIn_1);             // Set the button GPIO to be an input
-   gpio_set_debounce(gpioMeterIn_1, DEBOUNCE_TIME); // Debounce the button with a delay of 50ms
-                                                // the bool argument prevents the direction from being changed
+   // Debounce the input with a delay of 50us, in the IRQ thread if the GPIO controller can not
+   if (gpio_set_debounce(gpioMeterIn_1, DEBOUNCE_TIME)) {
+      printk(KERN_INFO "Ebox3 Inputs: No hardware debounce, using the software one\n");
+      swDebounce = true;
+   }
 
    // Causes all gpio to appear in /sys/class/gpio
    // the bool argument prevents the direction from being changed
@@ -159,12 +203,19 @@ static int __init ebox3Inputs_init(void) {
    if (!isRising) {                           // If the kernel parameter isRising=0 is supplied
       IRQflags = IRQF_TRIGGER_FALLING;      // Set the interrupt to be on the falling edge
    }
-   // This next call requests an interrupt line
-   result = request_irq(irqNumber,             // The interrupt number requested
-                        (irq_handler_t) ebox3gpio_irq_handler, // The pointer to the handler function below
+   // This next call requests an interrupt line and the thread that deals with its edges
+   result = request_threaded_irq(irqNumber,    // The interrupt number requested
+                        (irq_handler_t) ebox3gpio_irq_handler, // The pointer to the hard IRQ handler below
+                        (irq_handler_t) ebox3gpio_irq_thread,  // The pointer to the IRQ thread function below
                         IRQflags,              // Use the custom kernel param to set interrupt type
                         "ebox3_input_handler",  // Used in /proc/interrupts to identify the owner
                         NULL);                 // The *dev_id for shared interrupt lines, NULL is okay
+   if (result)
+      return result;
+
+   debugDir = debugfs_create_dir("ebox3inputs", NULL);
+   debugfs_create_file("irqstats", 0644, debugDir, NULL, &irqstats_fops);
+   debugfs_create_file("irq", 0644, debugDir, NULL, &irq_fops);
    return result;
 }
 
@@ -174,6 +225,7 @@ static int __init ebox3Inputs_init(void) {
  */
 static void __exit ebox3Inputs_exit(void) {
    printk(KERN_INFO "Ebox3 Inputs: The Meter0 was pulsed %d times\n", numberOfPulses);
+   debugfs_remove_recursive(debugDir);      // remove the histograms before the IRQ goes away
    kobject_put(ebox3_kobj);                 // clean up -- remove the kobject sysfs entry
    gpio_set_value(gpioMeterOut_1, 0);              // Turn the LED off, makes it clear the device was unloaded
    gpio_unexport(gpioMeterOut_1);                  // Unexport the LED GPIO
@@ -185,21 +237,64 @@ static void __exit ebox3Inputs_exit(void) {
 }
 
 /** @brief The GPIO IRQ Handler function
- *  This function is a custom interrupt handler that is attached to the GPIO above. The same interrupt
- *  handler cannot be invoked concurrently as the interrupt line is masked out until the function is complete.
+ *  This function is a custom interrupt handler that is attached to the GPIO above. It only takes
+ *  the time of the edge and queues it for ebox3gpio_irq_thread(), which does the rest with the
+ *  interrupts enabled. An edge that finds the queue full is lost.
  *  This function is static as it should not be invoked directly from outside of this file.
  *  @param irq    the IRQ number that is associated with the GPIO -- useful for logging.
  *  @param dev_id the *dev_id that is provided -- can be used to identify which device caused the interrupt
  *  Not used in this example as NULL is passed.
  *  @param regs   h/w specific register values -- only really ever used for debugging.
- *  return returns IRQ_HANDLED if successful -- should return IRQ_NONE otherwise.
+ *  return returns IRQ_WAKE_THREAD to run the IRQ thread.
  */
 static irq_handler_t ebox3gpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs) {
-   getnstimeofday(&ts_current);                 // Get the current time as ts_current
-   ts_diff = timespec64_to_timespec(timespec64_sub(timespec_to_timespec64(ts_current), timespec_to_timespec64(ts_last))); // Determine the time difference between last 2 presses
-   ts_last = ts_current;                        // Store the current time as the last time ts_last
-   printk(KERN_INFO "Ebox3 Inputs: The meter0 state is currently: %d\n", gpio_get_value(gpioMeterIn_1));
-   numberOfPulses++;                            // Global counter, will be outputted when the module is unloaded
+   u64 edge = ktime_get_ns();
+   unsigned int head = captureHead;
+
+   if (head - smp_load_acquire(&captureTail) < CAPTURE_SIZE) {
+      capture[head & (CAPTURE_SIZE - 1)] = edge;
+      smp_store_release(&captureHead, head + 1);
+   }
+   if (static_branch_unlikely(&irqStatsKey))
+      irq_hist_add(&irqStats.hardCost, ktime_get_ns() - edge);
+   return (irq_handler_t)IRQ_WAKE_THREAD;       // Let the IRQ thread count the edge
+}
+
+/** @brief The GPIO IRQ thread function
+ *  Debounces and counts the edges queued by ebox3gpio_irq_handler(). The thread of an IRQ never
+ *  runs concurrently with itself.
+ *  @param irq    the IRQ number that is associated with the GPIO -- useful for logging.
+ *  @param dev_id the *dev_id that is provided, NULL here
+ *  @param regs   not used
+ *  return returns IRQ_HANDLED
+ */
+static irq_handler_t ebox3gpio_irq_thread(unsigned int irq, void *dev_id, struct pt_regs *regs) {
+   unsigned int tail = captureTail;
+   u64 edge, start = 0;
+   bool bounce;
+
+   if (static_branch_unlikely(&irqStatsKey)) {
+      start = ktime_get_ns();
+      if (tail != smp_load_acquire(&captureHead))
+         irq_hist_add(&irqStats.wakeup, start - capture[tail & (CAPTURE_SIZE - 1)]);
+   }
+
+   while (tail != smp_load_acquire(&captureHead)) {
+      edge = capture[tail & (CAPTURE_SIZE - 1)];
+      smp_store_release(&captureTail, ++tail);
+      bounce = swDebounce && edge - lastEdge < DEBOUNCE_TIME * NSEC_PER_USEC;  // A bounce of the last accepted edge
+      if (trace_ebox3inputs_edge_enabled())     // Read the level only while somebody is tracing
+         trace_ebox3inputs_edge(gpioMeterIn_1, edge, gpio_get_value(gpioMeterIn_1), bounce);
+      if (bounce)
+         continue;
+      lastEdge = edge;
+      ts_current = ns_to_timespec(ktime_to_ns(ktime_mono_to_real(ns_to_ktime(edge)))); // The wall clock time of the edge
+      ts_diff = timespec64_to_timespec(timespec64_sub(timespec_to_timespec64(ts_current), timespec_to_timespec64(ts_last))); // Determine the time difference between last 2 presses
+      ts_last = ts_current;                     // Store the current time as the last time ts_last
+      numberOfPulses++;                         // Global counter, will be outputted when the module is unloaded
+   }
+   if (start)
+      irq_hist_add(&irqStats.threadCost, ktime_get_ns() - start);
    return (irq_handler_t)IRQ_HANDLED;           // Announce that the IRQ has been handled correctly
 }
 
@@ -0,0 +1,40 @@
+/**
+ * The tracepoints of the ebox3inputs LKM, turn them on with e.g.
+ *   echo 1 > /sys/kernel/debug/tracing/events/ebox3inputs/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ebox3inputs
+
+#if !defined(EBOX3INPUTS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define EBOX3INPUTS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** An input edge as seen by the IRQ thread, bounce is set if the software debounce dropped it */
+TRACE_EVENT(ebox3inputs_edge,
+   TP_PROTO(unsigned int gpio, u64 timestamp, int level, bool bounce),
+   TP_ARGS(gpio, timestamp, level, bounce),
+   TP_STRUCT__entry(
+      __field(unsigned int, gpio)
+      __field(u64, timestamp)
+      __field(int, level)
+      __field(bool, bounce)
+   ),
+   TP_fast_assign(
+      __entry->gpio      = gpio;
+      __entry->timestamp = timestamp;
+      __entry->level     = level;
+      __entry->bounce    = bounce;
+   ),
+   TP_printk("gpio%u timestamp=%llu level=%d%s", __entry->gpio, __entry->timestamp, __entry->level,
+             __entry->bounce ? " bounce" : "")
+);
+
+#endif
+
+// the header is read again by define_trace.h from this directory, the Makefile adds it to the include path
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE ebox3inputs_trace
+#include <trace/define_trace.h>
@@ -14,6 +14,11 @@
 #include <linux/kernel.h>
 #include <linux/gpio.h>                 // Required for the GPIO functions
 #include <linux/interrupt.h>            // Required for the IRQ code
+#include <linux/ktime.h>                // Timing the IRQ handler
+#include <linux/debugfs.h>              // The IRQ histogram at /sys/kernel/debug/gpio_test
+#include "../ebox3driver/ebox3irqstats.h"  // The IRQ histograms, shared with ebox3driver
+#define CREATE_TRACE_POINTS
+#include "gpio_test_trace.h"            // The gpio_test:gpio_test_edge tracepoint
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Derek Molloy");
@@ -26,9 +31,37 @@ static unsigned int irqNumber;          ///< Used to share the IRQ number within
 static unsigned int numberPresses = 0;  ///< For information, store the number of button presses
 static bool	    ledOn = 0;          ///< Is the LED on or off? Used to invert its state (off by default)
 
+static struct irq_hist hardCost;        ///< Filled in while /sys/kernel/debug/gpio_test/irqstats is on
+static struct dentry *debugDir;
+
 /// Function prototype for the custom IRQ handler function -- see below for the implementation
 static irq_handler_t  ebbgpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs);
 
+/** @brief Displays the IRQ handler histogram, times in nanoseconds */
+static int irq_show(struct seq_file *s, void *unused){
+   irq_hist_show(s, "hardirq", &hardCost);
+   return 0;
+}
+
+static int irq_open(struct inode *inode, struct file *filep){
+   return single_open(filep, irq_show, NULL);
+}
+
+/** @brief Any write clears the IRQ histogram */
+static ssize_t irq_write(struct file *filep, const char __user *buffer, size_t len, loff_t *offset){
+   irq_hist_reset(&hardCost);
+   return len;
+}
+
+static const struct file_operations irq_fops = {
+   .owner   = THIS_MODULE,
+   .open    = irq_open,
+   .read    = seq_read,
+   .write   = irq_write,
+   .llseek  = seq_lseek,
+   .release = single_release,
+};
+
 /** @brief The LKM initialization function
  *  The static keyword restricts the visibility of the function to within this C file. The __init
  *  macro means that for a built-in driver (not a LKM) the function is only used at initialization
@@ -71,6 +104,12 @@ static int __init ebbgpio_init(void){
                         NULL);                 // The *dev_id for shared interrupt lines, NULL is okay
 
    printk(KERN_INFO "GPIO_TEST: The interrupt request result is: %d\n", result);
+   if (result)
+      return result;
+
+   debugDir = debugfs_create_dir("gpio_test", NULL);
+   debugfs_create_file("irqstats", 0644, debugDir, NULL, &irqstats_fops);
+   debugfs_create_file("irq", 0644, debugDir, NULL, &irq_fops);
    return result;
 }
 
@@ -82,6 +121,7 @@ static int __init ebbgpio_init(void){
 static void __exit ebbgpio_exit(void){
    printk(KERN_INFO "GPIO_TEST: The button state is currently: %d\n", gpio_get_value(gpioButton));
    printk(KERN_INFO "GPIO_TEST: The button was pressed %d times\n", numberPresses);
+   debugfs_remove_recursive(debugDir);      // Remove the histogram before the IRQ goes away
    gpio_set_value(gpioLED, 0);              // Turn the LED off, makes it clear the device was unloaded
    gpio_unexport(gpioLED);                  // Unexport the LED GPIO
    free_irq(irqNumber, NULL);               // Free the IRQ number, no *dev_id required in this case
@@ -102,10 +142,17 @@ static void __exit ebbgpio_exit(void){
  *  return returns IRQ_HANDLED if successful -- should return IRQ_NONE otherwise.
  */
 static irq_handler_t ebbgpio_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs){
+   u64 start = 0;
+
+   if (static_branch_unlikely(&irqStatsKey))
+      start = ktime_get_ns();
    ledOn = !ledOn;                          // Invert the LED state on each button press
    gpio_set_value(gpioLED, ledOn);          // Set the physical LED accordingly
-   printk(KERN_INFO "GPIO_TEST: Interrupt! (button state is %d)\n", gpio_get_value(gpioButton));
+   if (trace_gpio_test_edge_enabled())      // Read the button only while somebody is tracing
+      trace_gpio_test_edge(gpioButton, gpio_get_value(gpioButton), ledOn);
    numberPresses++;                         // Global counter, will be outputted when the module is unloaded
+   if (start)
+      irq_hist_add(&hardCost, ktime_get_ns() - start);
    return (irq_handler_t) IRQ_HANDLED;      // Announce that the IRQ has been handled correctly
 }
 
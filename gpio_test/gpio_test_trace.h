@@ -0,0 +1,37 @@
+/**
+ * The tracepoints of the gpio_test LKM, turn them on with e.g.
+ *   echo 1 > /sys/kernel/debug/tracing/events/gpio_test/enable
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM gpio_test
+
+#if !defined(GPIO_TEST_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define GPIO_TEST_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/** A button interrupt, level is the button state and led the new LED state */
+TRACE_EVENT(gpio_test_edge,
+   TP_PROTO(unsigned int gpio, int level, bool led),
+   TP_ARGS(gpio, level, led),
+   TP_STRUCT__entry(
+      __field(unsigned int, gpio)
+      __field(int, level)
+      __field(bool, led)
+   ),
+   TP_fast_assign(
+      __entry->gpio  = gpio;
+      __entry->level = level;
+      __entry->led   = led;
+   ),
+   TP_printk("gpio%u level=%d led=%d", __entry->gpio, __entry->level, __entry->led)
+);
+
+#endif
+
+// the header is read again by define_trace.h from this directory, the Makefile adds it to the include path
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE gpio_test_trace
+#include <trace/define_trace.h>